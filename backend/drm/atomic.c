@@ -155,6 +155,9 @@ static void set_plane_props(struct atomic *atom, struct wlr_drm_backend *drm,
 	atomic_add(atom, id, props->crtc_id, crtc_id);
 	atomic_add(atom, id, props->crtc_x, (uint64_t)x);
 	atomic_add(atom, id, props->crtc_y, (uint64_t)y);
+	if (plane->zpos_mutable) {
+		atomic_add(atom, id, props->zpos, plane->zpos);
+	}
 
 	return;
 
@@ -163,6 +166,36 @@ error:
 	atom->failed = true;
 }
 
+static void set_overlay_plane_props(struct atomic *atom,
+		struct wlr_drm_plane *plane, uint32_t crtc_id,
+		const struct wlr_box *dst_box) {
+	uint32_t id = plane->id;
+	const union wlr_drm_plane_props *props = &plane->props;
+	struct wlr_drm_fb *fb = plane->pending_fb;
+	if (fb == NULL) {
+		wlr_log(WLR_ERROR, "Failed to set plane %"PRIu32" properties: "
+			"missing FB", plane->id);
+		atom->failed = true;
+		return;
+	}
+
+	// The src_* properties are in 16.16 fixed point
+	atomic_add(atom, id, props->src_x, 0);
+	atomic_add(atom, id, props->src_y, 0);
+	atomic_add(atom, id, props->src_w, (uint64_t)fb->wlr_buf->width << 16);
+	atomic_add(atom, id, props->src_h, (uint64_t)fb->wlr_buf->height << 16);
+	atomic_add(atom, id, props->crtc_w, (uint64_t)dst_box->width);
+	atomic_add(atom, id, props->crtc_h, (uint64_t)dst_box->height);
+	atomic_add(atom, id, props->fb_id, fb->id);
+	atomic_add(atom, id, props->crtc_id, crtc_id);
+	atomic_add(atom, id, props->crtc_x, (uint64_t)dst_box->x);
+	atomic_add(atom, id, props->crtc_y, (uint64_t)dst_box->y);
+	// Assigned at init time so that the plane sits above the primary
+	if (plane->zpos_mutable) {
+		atomic_add(atom, id, props->zpos, plane->zpos);
+	}
+}
+
 static bool atomic_crtc_commit(struct wlr_drm_connector *conn,
 		const struct wlr_drm_connector_state *state, uint32_t flags,
 		bool test_only) {
@@ -250,6 +283,15 @@ static bool atomic_crtc_commit(struct wlr_drm_connector *conn,
 			atomic_add(&atom, crtc->primary->id,
 				crtc->primary->props.fb_damage_clips, fb_damage_clips);
 		}
+		// The kernel waits for the fence before scanning out the buffer,
+		// instead of relying on implicit synchronization. On multi-GPU
+		// setups, the plane displays a copy blitted by our own renderer, which
+		// the primary GPU's fence doesn't cover: keep using implicit sync.
+		if ((state->base->committed & WLR_OUTPUT_STATE_IN_FENCE) &&
+				crtc->primary->props.in_fence_fd != 0 && drm->parent == NULL) {
+			atomic_add(&atom, crtc->primary->id,
+				crtc->primary->props.in_fence_fd, state->base->in_fence_fd);
+		}
 		if (crtc->cursor) {
 			if (drm_connector_is_cursor_visible(conn)) {
 				set_plane_props(&atom, drm, crtc->cursor, crtc->id,
@@ -258,11 +300,25 @@ static bool atomic_crtc_commit(struct wlr_drm_connector *conn,
 				plane_disable(&atom, crtc->cursor);
 			}
 		}
+		if (state->base->committed & WLR_OUTPUT_STATE_OVERLAYS) {
+			for (size_t i = 0; i < crtc->overlays_len; i++) {
+				struct wlr_drm_plane *plane = crtc->overlays[i];
+				if (i < state->base->overlays_len) {
+					set_overlay_plane_props(&atom, plane, crtc->id,
+						&state->base->overlays[i].dst_box);
+				} else {
+					plane_disable(&atom, plane);
+				}
+			}
+		}
 	} else {
 		plane_disable(&atom, crtc->primary);
 		if (crtc->cursor) {
 			plane_disable(&atom, crtc->cursor);
 		}
+		for (size_t i = 0; i < crtc->overlays_len; i++) {
+			plane_disable(&atom, crtc->overlays[i]);
+		}
 	}
 
 	bool ok = atomic_commit(&atom, conn, flags);
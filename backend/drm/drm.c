@@ -36,7 +36,8 @@ static const uint32_t SUPPORTED_OUTPUT_STATE =
 	WLR_OUTPUT_STATE_BUFFER |
 	WLR_OUTPUT_STATE_MODE |
 	WLR_OUTPUT_STATE_ENABLED |
-	WLR_OUTPUT_STATE_GAMMA_LUT;
+	WLR_OUTPUT_STATE_GAMMA_LUT |
+	WLR_OUTPUT_STATE_OVERLAYS;
 
 bool check_drm_features(struct wlr_drm_backend *drm) {
 	if (drmGetCap(drm->fd, DRM_CAP_CURSOR_WIDTH, &drm->cursor_width)) {
@@ -114,10 +115,31 @@ static bool add_plane(struct wlr_drm_backend *drm,
 		return false;
 	}
 
+	struct wlr_drm_plane **overlays = NULL;
+	if (type == DRM_PLANE_TYPE_OVERLAY) {
+		overlays = realloc(crtc->overlays,
+			(crtc->overlays_len + 1) * sizeof(crtc->overlays[0]));
+		if (!overlays) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			free(p);
+			return false;
+		}
+		crtc->overlays = overlays;
+	}
+
 	p->type = type;
 	p->id = drm_plane->plane_id;
 	p->props = *props;
 
+	bool zpos_immutable = true;
+	if (p->props.zpos && (!get_drm_prop(drm->fd, p->id, p->props.zpos,
+			&p->zpos) || !get_drm_prop_range(drm->fd, p->props.zpos,
+			&p->zpos_min, &p->zpos_max, &zpos_immutable))) {
+		wlr_log(WLR_DEBUG, "Failed to read zpos of plane %"PRIu32, p->id);
+		p->props.zpos = 0;
+	}
+	p->zpos_mutable = p->props.zpos && !zpos_immutable;
+
 	for (size_t j = 0; j < drm_plane->count_formats; ++j) {
 		wlr_drm_format_set_add(&p->formats, drm_plane->formats[j],
 			DRM_FORMAT_MOD_INVALID);
@@ -150,9 +172,9 @@ static bool add_plane(struct wlr_drm_backend *drm,
 		}
 
 		drmModeFreePropertyBlob(blob);
-	} else if (type == DRM_PLANE_TYPE_CURSOR) {
-		// Force a LINEAR layout for the cursor if the driver doesn't support
-		// modifiers
+	} else if (type != DRM_PLANE_TYPE_PRIMARY) {
+		// Force a LINEAR layout for the cursor and overlays if the driver
+		// doesn't support modifiers
 		for (size_t i = 0; i < p->formats.len; ++i) {
 			wlr_drm_format_set_add(&p->formats, p->formats.formats[i]->format,
 				DRM_FORMAT_MOD_LINEAR);
@@ -166,6 +188,9 @@ static bool add_plane(struct wlr_drm_backend *drm,
 	case DRM_PLANE_TYPE_CURSOR:
 		crtc->cursor = p;
 		break;
+	case DRM_PLANE_TYPE_OVERLAY:
+		crtc->overlays[crtc->overlays_len++] = p;
+		break;
 	default:
 		abort();
 	}
@@ -173,10 +198,49 @@ static bool add_plane(struct wlr_drm_backend *drm,
 	return true;
 
 error:
+	wlr_drm_format_set_finish(&p->formats);
 	free(p);
 	return false;
 }
 
+/**
+ * Overlays are only useful above the primary plane: drop those which can't
+ * be placed there, and pick a zpos for those whose zpos can be changed.
+ * Without zpos properties, the stacking order is up to the driver and
+ * overlays are assumed to be above.
+ */
+static void crtc_init_overlay_zpos(struct wlr_drm_crtc *crtc) {
+	struct wlr_drm_plane *primary = crtc->primary;
+	if (primary == NULL || !primary->props.zpos) {
+		return;
+	}
+
+	size_t n = 0;
+	for (size_t i = 0; i < crtc->overlays_len; i++) {
+		struct wlr_drm_plane *plane = crtc->overlays[i];
+		bool above = true;
+		if (plane->props.zpos && plane->zpos_mutable) {
+			plane->zpos = primary->zpos + 1;
+			if (plane->zpos < plane->zpos_min) {
+				plane->zpos = plane->zpos_min;
+			}
+			above = plane->zpos <= plane->zpos_max;
+		} else if (plane->props.zpos) {
+			above = plane->zpos > primary->zpos;
+		}
+
+		if (!above) {
+			wlr_log(WLR_DEBUG, "Overlay plane %"PRIu32" can't be placed above "
+				"primary plane %"PRIu32", ignoring it", plane->id, primary->id);
+			wlr_drm_format_set_finish(&plane->formats);
+			free(plane);
+			continue;
+		}
+		crtc->overlays[n++] = plane;
+	}
+	crtc->overlays_len = n;
+}
+
 static bool init_planes(struct wlr_drm_backend *drm) {
 	drmModePlaneRes *plane_res = drmModeGetPlaneResources(drm->fd);
 	if (!plane_res) {
@@ -207,13 +271,6 @@ static bool init_planes(struct wlr_drm_backend *drm) {
 			goto error;
 		}
 
-		// We don't really care about overlay planes, as we don't support them
-		// yet.
-		if (type == DRM_PLANE_TYPE_OVERLAY) {
-			drmModeFreePlane(plane);
-			continue;
-		}
-
 		assert(drm->num_crtcs <= 32);
 		struct wlr_drm_crtc *crtc = NULL;
 		for (size_t j = 0; j < drm->num_crtcs ; j++) {
@@ -223,6 +280,13 @@ static bool init_planes(struct wlr_drm_backend *drm) {
 			}
 
 			struct wlr_drm_crtc *candidate = &drm->crtcs[j];
+			if (type == DRM_PLANE_TYPE_OVERLAY) {
+				// Spread overlay planes evenly across CRTCs
+				if (!crtc || candidate->overlays_len < crtc->overlays_len) {
+					crtc = candidate;
+				}
+				continue;
+			}
 			if ((type == DRM_PLANE_TYPE_PRIMARY && !candidate->primary) ||
 					(type == DRM_PLANE_TYPE_CURSOR && !candidate->cursor)) {
 				crtc = candidate;
@@ -242,6 +306,10 @@ static bool init_planes(struct wlr_drm_backend *drm) {
 		drmModeFreePlane(plane);
 	}
 
+	for (size_t i = 0; i < drm->num_crtcs; i++) {
+		crtc_init_overlay_zpos(&drm->crtcs[i]);
+	}
+
 	drmModeFreePlaneResources(plane_res);
 	return true;
 
@@ -318,6 +386,11 @@ void finish_drm_resources(struct wlr_drm_backend *drm) {
 			wlr_drm_format_set_finish(&crtc->cursor->formats);
 			free(crtc->cursor);
 		}
+		for (size_t j = 0; j < crtc->overlays_len; j++) {
+			wlr_drm_format_set_finish(&crtc->overlays[j]->formats);
+			free(crtc->overlays[j]);
+		}
+		free(crtc->overlays);
 	}
 
 	free(drm->crtcs);
@@ -338,13 +411,28 @@ static bool drm_crtc_commit(struct wlr_drm_connector *conn,
 	struct wlr_drm_backend *drm = conn->backend;
 	struct wlr_drm_crtc *crtc = conn->crtc;
 	bool ok = drm->iface->crtc_commit(conn, state, flags, test_only);
+	bool overlays = state->base->committed & WLR_OUTPUT_STATE_OVERLAYS;
 	if (ok && !test_only) {
 		drm_fb_move(&crtc->primary->queued_fb, &crtc->primary->pending_fb);
 		if (crtc->cursor != NULL) {
 			drm_fb_move(&crtc->cursor->queued_fb, &crtc->cursor->pending_fb);
 		}
+		for (size_t i = 0; i < crtc->overlays_len; i++) {
+			struct wlr_drm_plane *plane = crtc->overlays[i];
+			if (!state->active) {
+				// Overlay planes are disabled along with the CRTC
+				drm_plane_finish_surface(plane);
+				plane->queued = false;
+			} else if (overlays) {
+				drm_fb_move(&plane->queued_fb, &plane->pending_fb);
+				plane->queued = true;
+			}
+		}
 	} else {
 		drm_fb_clear(&crtc->primary->pending_fb);
+		for (size_t i = 0; i < crtc->overlays_len; i++) {
+			drm_fb_clear(&crtc->overlays[i]->pending_fb);
+		}
 		// The set_cursor() hook is a bit special: it's not really synchronized
 		// to commit() or test(). Once set_cursor() returns true, the new
 		// cursor is effectively committed. So don't roll it back here, or we
@@ -465,6 +553,33 @@ static bool drm_connector_set_pending_fb(struct wlr_drm_connector *conn,
 	return true;
 }
 
+static bool drm_connector_set_pending_overlays(struct wlr_drm_connector *conn,
+		const struct wlr_output_state *state) {
+	struct wlr_drm_backend *drm = conn->backend;
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	assert(state->committed & WLR_OUTPUT_STATE_OVERLAYS);
+	assert(state->overlays_len <= crtc->overlays_len);
+
+	for (size_t i = 0; i < crtc->overlays_len; i++) {
+		struct wlr_drm_plane *plane = crtc->overlays[i];
+		if (i >= state->overlays_len) {
+			drm_fb_clear(&plane->pending_fb);
+			continue;
+		}
+
+		const struct wlr_output_overlay *overlay = &state->overlays[i];
+		if (!drm_fb_import(&plane->pending_fb, drm, overlay->buffer,
+				&plane->formats)) {
+			wlr_drm_conn_log(conn, WLR_DEBUG,
+				"Failed to import buffer for overlay plane %"PRIu32,
+				plane->id);
+			return false;
+		}
+	}
+
+	return true;
+}
+
 static bool drm_connector_alloc_crtc(struct wlr_drm_connector *conn);
 
 static bool drm_connector_test(struct wlr_output *output) {
@@ -510,6 +625,26 @@ static bool drm_connector_test(struct wlr_output *output) {
 		}
 	}
 
+	if (output->pending.committed & WLR_OUTPUT_STATE_OVERLAYS) {
+		size_t overlays_len = output->pending.overlays_len;
+		if (conn->backend->parent && overlays_len > 0) {
+			wlr_drm_conn_log(conn, WLR_DEBUG,
+				"Overlays are not supported on secondary GPUs");
+			return false;
+		}
+		if (conn->backend->iface == &legacy_iface && overlays_len > 0) {
+			wlr_drm_conn_log(conn, WLR_DEBUG,
+				"Overlays are not supported with the legacy DRM interface");
+			return false;
+		}
+		if (overlays_len > 0 && (conn->crtc == NULL ||
+				overlays_len > conn->crtc->overlays_len)) {
+			wlr_drm_conn_log(conn, WLR_DEBUG,
+				"Not enough overlay planes available");
+			return false;
+		}
+	}
+
 	if (conn->backend->parent) {
 		// If we're running as a secondary GPU, we can't perform an atomic
 		// commit without blitting a buffer.
@@ -527,6 +662,12 @@ static bool drm_connector_test(struct wlr_output *output) {
 			return false;
 		}
 	}
+	if (output->pending.committed & WLR_OUTPUT_STATE_OVERLAYS) {
+		if (!drm_connector_set_pending_overlays(conn, pending.base)) {
+			drm_fb_clear(&conn->crtc->primary->pending_fb);
+			return false;
+		}
+	}
 
 	return drm_crtc_commit(conn, &pending, 0, true);
 }
@@ -584,6 +725,12 @@ bool drm_connector_commit_state(struct wlr_drm_connector *conn,
 			return false;
 		}
 	}
+	if (pending.base->committed & WLR_OUTPUT_STATE_OVERLAYS) {
+		if (!drm_connector_set_pending_overlays(conn, pending.base)) {
+			drm_fb_clear(&conn->crtc->primary->pending_fb);
+			return false;
+		}
+	}
 
 	if (pending.modeset) {
 		if (!drm_connector_set_mode(conn, &pending)) {
@@ -1040,6 +1187,10 @@ static void dealloc_crtc(struct wlr_drm_connector *conn) {
 
 	drm_plane_finish_surface(conn->crtc->primary);
 	drm_plane_finish_surface(conn->crtc->cursor);
+	for (size_t i = 0; i < conn->crtc->overlays_len; i++) {
+		drm_plane_finish_surface(conn->crtc->overlays[i]);
+		conn->crtc->overlays[i]->queued = false;
+	}
 
 	conn->cursor_enabled = false;
 	conn->crtc = NULL;
@@ -1445,6 +1596,13 @@ static void handle_page_flip(int fd, unsigned seq,
 		drm_fb_move(&conn->crtc->cursor->current_fb,
 			&conn->crtc->cursor->queued_fb);
 	}
+	for (size_t i = 0; i < conn->crtc->overlays_len; i++) {
+		struct wlr_drm_plane *overlay = conn->crtc->overlays[i];
+		if (overlay->queued) {
+			drm_fb_move(&overlay->current_fb, &overlay->queued_fb);
+			overlay->queued = false;
+		}
+	}
 
 	uint32_t present_flags = WLR_OUTPUT_PRESENT_VSYNC |
 		WLR_OUTPUT_PRESENT_HW_CLOCK | WLR_OUTPUT_PRESENT_HW_COMPLETION;
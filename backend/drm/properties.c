@@ -51,6 +51,7 @@ static const struct prop_info plane_info[] = {
 	{ "CRTC_Y", INDEX(crtc_y) },
 	{ "FB_DAMAGE_CLIPS", INDEX(fb_damage_clips) },
 	{ "FB_ID", INDEX(fb_id) },
+	{ "IN_FENCE_FD", INDEX(in_fence_fd) },
 	{ "IN_FORMATS", INDEX(in_formats) },
 	{ "SRC_H", INDEX(src_h) },
 	{ "SRC_W", INDEX(src_w) },
@@ -58,6 +59,7 @@ static const struct prop_info plane_info[] = {
 	{ "SRC_Y", INDEX(src_y) },
 	{ "rotation", INDEX(rotation) },
 	{ "type", INDEX(type) },
+	{ "zpos", INDEX(zpos) },
 #undef INDEX
 };
 
@@ -180,3 +182,22 @@ char *get_drm_prop_enum(int fd, uint32_t obj, uint32_t prop_id) {
 
 	return str;
 }
+
+bool get_drm_prop_range(int fd, uint32_t prop_id, uint64_t *min, uint64_t *max,
+		bool *immutable) {
+	drmModePropertyRes *prop = drmModeGetProperty(fd, prop_id);
+	if (!prop) {
+		return false;
+	}
+
+	bool ok = drm_property_type_is(prop, DRM_MODE_PROP_RANGE) &&
+		prop->count_values == 2;
+	if (ok) {
+		*min = prop->values[0];
+		*max = prop->values[1];
+		*immutable = prop->flags & DRM_MODE_PROP_IMMUTABLE;
+	}
+
+	drmModeFreeProperty(prop);
+	return ok;
+}
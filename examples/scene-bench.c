@@ -0,0 +1,432 @@
+#define _POSIX_C_SOURCE 200112L
+#include <drm_fourcc.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+
+/* Scene-graph benchmark. Builds a synthetic tree and runs scripted workloads
+ * against it on a headless output with the pixman renderer, then prints
+ * latency percentiles for each phase. No GPU is required.
+ *
+ * The output runs at BENCH_REFRESH, so that waiting for frame events between
+ * commits doesn't dominate the run time.
+ *
+ * The tree has `depth` levels of sub-trees with `width` children each. The
+ * leaves are a mix of rects and buffers. */
+
+#define BENCH_REFRESH 1000000 // mHz, the highest the headless backend supports
+
+struct bench_buffer {
+	struct wlr_buffer base;
+	void *data;
+	size_t stride;
+};
+
+static void bench_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+	struct bench_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	free(buffer->data);
+	free(buffer);
+}
+
+static bool bench_buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
+	struct bench_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	*data = buffer->data;
+	*format = DRM_FORMAT_ARGB8888;
+	*stride = buffer->stride;
+	return true;
+}
+
+static void bench_buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
+	// This space is intentionally left blank
+}
+
+static const struct wlr_buffer_impl bench_buffer_impl = {
+	.destroy = bench_buffer_destroy,
+	.begin_data_ptr_access = bench_buffer_begin_data_ptr_access,
+	.end_data_ptr_access = bench_buffer_end_data_ptr_access,
+};
+
+static struct wlr_buffer *bench_buffer_create(int width, int height) {
+	struct bench_buffer *buffer = calloc(1, sizeof(*buffer));
+	if (buffer == NULL) {
+		return NULL;
+	}
+	buffer->stride = width * 4;
+	buffer->data = malloc(buffer->stride * height);
+	if (buffer->data == NULL) {
+		free(buffer);
+		return NULL;
+	}
+	memset(buffer->data, 0x80, buffer->stride * height);
+	wlr_buffer_init(&buffer->base, &bench_buffer_impl, width, height);
+	return &buffer->base;
+}
+
+struct bench {
+	struct wl_event_loop *event_loop;
+	struct wlr_scene *scene;
+	struct wlr_scene_output *scene_output;
+	struct wlr_buffer *buffer;
+
+	struct wl_listener frame;
+	bool frame_pending;
+
+	int depth, width, rect_percent;
+	int output_width, output_height;
+
+	// Flat lists of the nodes, for random picks
+	struct wlr_scene_node **trees;
+	size_t trees_len, trees_cap;
+	struct wlr_scene_node **leaves;
+	size_t leaves_len, leaves_cap;
+};
+
+struct samples {
+	double *values; // in microseconds
+	size_t len;
+};
+
+static void append_node(struct wlr_scene_node ***nodes, size_t *len,
+		size_t *cap, struct wlr_scene_node *node) {
+	if (*len == *cap) {
+		*cap = *cap == 0 ? 64 : *cap * 2;
+		*nodes = realloc(*nodes, *cap * sizeof(**nodes));
+		if (*nodes == NULL) {
+			fprintf(stderr, "Allocation failed\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	(*nodes)[(*len)++] = node;
+}
+
+static int random_int(int max) {
+	return max > 0 ? rand() % max : 0;
+}
+
+static void build_tree(struct bench *bench, struct wlr_scene_node *parent,
+		int level) {
+	for (int i = 0; i < bench->width; i++) {
+		if (level < bench->depth) {
+			struct wlr_scene_tree *tree = wlr_scene_tree_create(parent);
+			wlr_scene_node_set_position(&tree->node,
+				random_int(bench->output_width / 4),
+				random_int(bench->output_height / 4));
+			append_node(&bench->trees, &bench->trees_len, &bench->trees_cap,
+				&tree->node);
+			build_tree(bench, &tree->node, level + 1);
+			continue;
+		}
+
+		struct wlr_scene_node *node;
+		if (random_int(100) < bench->rect_percent) {
+			float color[4] = {
+				random_int(256) / 255.0f, random_int(256) / 255.0f,
+				random_int(256) / 255.0f, random_int(2) ? 1.0f : 0.5f,
+			};
+			struct wlr_scene_rect *rect = wlr_scene_rect_create(parent,
+				8 + random_int(120), 8 + random_int(120), color);
+			node = &rect->node;
+		} else {
+			struct wlr_scene_buffer *scene_buffer =
+				wlr_scene_buffer_create(parent, bench->buffer);
+			node = &scene_buffer->node;
+		}
+		wlr_scene_node_set_position(node,
+			random_int(bench->output_width / 2),
+			random_int(bench->output_height / 2));
+		append_node(&bench->leaves, &bench->leaves_len, &bench->leaves_cap,
+			node);
+	}
+}
+
+static double now_usec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double da = *(const double *)a, db = *(const double *)b;
+	return (da > db) - (da < db);
+}
+
+static void samples_init(struct samples *samples, size_t cap) {
+	samples->values = calloc(cap, sizeof(samples->values[0]));
+	samples->len = 0;
+	if (samples->values == NULL) {
+		fprintf(stderr, "Allocation failed\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static double percentile(const struct samples *samples, double p) {
+	size_t i = (size_t)(p / 100.0 * (samples->len - 1) + 0.5);
+	return samples->values[i];
+}
+
+static void samples_report(struct samples *samples, const char *phase) {
+	if (samples->len == 0) {
+		printf("%-12s %8s\n", phase, "no samples");
+		return;
+	}
+	qsort(samples->values, samples->len, sizeof(samples->values[0]),
+		compare_double);
+	printf("%-12s %8zu %10.2f %10.2f %10.2f %10.2f\n", phase, samples->len,
+		percentile(samples, 50), percentile(samples, 90),
+		percentile(samples, 99), samples->values[samples->len - 1]);
+	free(samples->values);
+}
+
+static void run_node_at(struct bench *bench, int iterations) {
+	struct samples samples;
+	samples_init(&samples, iterations);
+	for (int i = 0; i < iterations; i++) {
+		double x = random_int(bench->output_width);
+		double y = random_int(bench->output_height);
+		double nx, ny;
+		double start = now_usec();
+		wlr_scene_node_at(&bench->scene->node, x, y, &nx, &ny);
+		samples.values[samples.len++] = now_usec() - start;
+	}
+	samples_report(&samples, "node_at");
+}
+
+static void run_reparent(struct bench *bench, int iterations) {
+	if (bench->trees_len == 0) {
+		return;
+	}
+	struct samples samples;
+	samples_init(&samples, iterations);
+	for (int i = 0; i < iterations; i++) {
+		struct wlr_scene_node *node =
+			bench->leaves[random_int(bench->leaves_len)];
+		struct wlr_scene_node *parent =
+			bench->trees[random_int(bench->trees_len)];
+		double start = now_usec();
+		wlr_scene_node_reparent(node, parent);
+		samples.values[samples.len++] = now_usec() - start;
+	}
+	samples_report(&samples, "reparent");
+}
+
+static void run_damage(struct bench *bench, int iterations) {
+	struct samples samples;
+	samples_init(&samples, iterations);
+	for (int i = 0; i < iterations; i++) {
+		struct wlr_scene_node *node =
+			bench->leaves[random_int(bench->leaves_len)];
+		double start = now_usec();
+		wlr_scene_node_set_position(node,
+			random_int(bench->output_width / 2),
+			random_int(bench->output_height / 2));
+		samples.values[samples.len++] = now_usec() - start;
+	}
+	samples_report(&samples, "damage");
+}
+
+static void handle_output_frame(struct wl_listener *listener, void *data) {
+	struct bench *bench = wl_container_of(listener, bench, frame);
+	bench->frame_pending = false;
+}
+
+/* Commits the scene output, then dispatches events until the output's frame
+ * event: the next commit would fail while the frame is pending. Only the
+ * commit itself is timed. */
+static bool commit_frame(struct bench *bench, double *duration) {
+	struct wlr_output *output = bench->scene_output->output;
+
+	double start = now_usec();
+	bool ok = wlr_scene_output_commit(bench->scene_output);
+	if (duration != NULL) {
+		*duration = now_usec() - start;
+	}
+
+	if (!ok) {
+		wlr_output_rollback(output);
+		return false;
+	}
+
+	bench->frame_pending = true;
+	while (bench->frame_pending) {
+		if (wl_event_loop_dispatch(bench->event_loop, -1) < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool run_commit(struct bench *bench, int iterations, bool full) {
+	struct samples samples;
+	samples_init(&samples, iterations);
+	for (int i = 0; i < iterations; i++) {
+		if (full) {
+			wlr_output_damage_add_whole(bench->scene_output->damage);
+		} else {
+			struct wlr_scene_node *node =
+				bench->leaves[random_int(bench->leaves_len)];
+			wlr_scene_node_set_position(node,
+				random_int(bench->output_width / 2),
+				random_int(bench->output_height / 2));
+		}
+		double duration;
+		if (!commit_frame(bench, &duration)) {
+			fprintf(stderr, "Failed to commit output\n");
+			free(samples.values);
+			return false;
+		}
+		samples.values[samples.len++] = duration;
+	}
+	samples_report(&samples, full ? "commit_full" : "commit");
+	return true;
+}
+
+static const char usage[] =
+	"usage: %s [options]\n"
+	"  -d <depth>       levels of sub-trees (default: 3)\n"
+	"  -w <width>       children per sub-tree (default: 8)\n"
+	"  -r <percent>     percentage of rects among leaves (default: 70)\n"
+	"  -n <iterations>  iterations per workload (default: 1000)\n"
+	"  -s <WxH>         output size (default: 1920x1080)\n"
+	"  -S <seed>        random seed (default: 1)\n";
+
+int main(int argc, char *argv[]) {
+	wlr_log_init(WLR_ERROR, NULL);
+
+	struct bench bench = {
+		.depth = 3,
+		.width = 8,
+		.rect_percent = 70,
+		.output_width = 1920,
+		.output_height = 1080,
+	};
+	int iterations = 1000;
+	unsigned int seed = 1;
+
+	int c;
+	while ((c = getopt(argc, argv, "d:w:r:n:s:S:h")) != -1) {
+		switch (c) {
+		case 'd':
+			bench.depth = atoi(optarg);
+			break;
+		case 'w':
+			bench.width = atoi(optarg);
+			break;
+		case 'r':
+			bench.rect_percent = atoi(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			if (sscanf(optarg, "%dx%d", &bench.output_width,
+					&bench.output_height) != 2) {
+				fprintf(stderr, usage, argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, usage, argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind < argc || bench.depth < 0 || bench.width <= 0 ||
+			iterations <= 0 || bench.output_width <= 0 ||
+			bench.output_height <= 0) {
+		fprintf(stderr, usage, argv[0]);
+		return EXIT_FAILURE;
+	}
+	srand(seed);
+
+	struct wl_display *display = wl_display_create();
+	struct wlr_renderer *renderer = wlr_pixman_renderer_create();
+	if (renderer == NULL) {
+		fprintf(stderr, "Failed to create pixman renderer\n");
+		return EXIT_FAILURE;
+	}
+	struct wlr_backend *backend =
+		wlr_headless_backend_create_with_renderer(display, renderer);
+	if (backend == NULL || !wlr_backend_start(backend)) {
+		fprintf(stderr, "Failed to start headless backend\n");
+		return EXIT_FAILURE;
+	}
+
+	bench.event_loop = wl_display_get_event_loop(display);
+
+	struct wlr_output *output = wlr_headless_add_output(backend,
+		bench.output_width, bench.output_height);
+	wlr_output_set_custom_mode(output, bench.output_width,
+		bench.output_height, BENCH_REFRESH);
+	wlr_output_enable(output, true);
+	if (!wlr_output_commit(output)) {
+		fprintf(stderr, "Failed to enable headless output\n");
+		return EXIT_FAILURE;
+	}
+
+	bench.buffer = bench_buffer_create(64, 64);
+	if (bench.buffer == NULL) {
+		fprintf(stderr, "Allocation failed\n");
+		return EXIT_FAILURE;
+	}
+
+	bench.frame.notify = handle_output_frame;
+	wl_signal_add(&output->events.frame, &bench.frame);
+
+	bench.scene = wlr_scene_create();
+	bench.scene_output = wlr_scene_output_create(bench.scene, output);
+
+	double start = now_usec();
+	build_tree(&bench, &bench.scene->node, 1);
+	double build_time = now_usec() - start;
+	if (bench.leaves_len == 0) {
+		fprintf(stderr, "The tree has no leaves\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("%zu trees, %zu leaves, built in %.2f us\n\n",
+		bench.trees_len, bench.leaves_len, build_time);
+	printf("%-12s %8s %10s %10s %10s %10s\n",
+		"phase", "samples", "p50 (us)", "p90 (us)", "p99 (us)", "max (us)");
+
+	// Render the initial frame, so that later commits are incremental
+	if (!commit_frame(&bench, NULL)) {
+		fprintf(stderr, "Failed to commit output\n");
+		return EXIT_FAILURE;
+	}
+
+	run_node_at(&bench, iterations);
+	run_reparent(&bench, iterations);
+	run_damage(&bench, iterations);
+	if (!run_commit(&bench, iterations, false) ||
+			!run_commit(&bench, iterations, true)) {
+		return EXIT_FAILURE;
+	}
+
+	wl_list_remove(&bench.frame.link);
+	wlr_scene_node_destroy(&bench.scene->node);
+	wlr_buffer_drop(bench.buffer);
+	free(bench.trees);
+	free(bench.leaves);
+
+	wlr_backend_destroy(backend);
+	wlr_renderer_destroy(renderer);
+	wl_display_destroy(display);
+	return EXIT_SUCCESS;
+}
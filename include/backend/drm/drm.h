@@ -28,10 +28,19 @@ struct wlr_drm_plane {
 	struct wlr_drm_fb *queued_fb;
 	/* Buffer currently displayed on screen */
 	struct wlr_drm_fb *current_fb;
+	/* Overlay planes only: queued_fb replaces current_fb on next page-flip,
+	 * even if NULL */
+	bool queued;
 
 	struct wlr_drm_format_set formats;
 
 	union wlr_drm_plane_props props;
+
+	/* Position in the plane stack, only valid if props.zpos is set. If
+	 * zpos_mutable, this is the value programmed on each commit. */
+	uint64_t zpos;
+	uint64_t zpos_min, zpos_max;
+	bool zpos_mutable;
 };
 
 struct wlr_drm_crtc {
@@ -48,6 +57,9 @@ struct wlr_drm_crtc {
 	struct wlr_drm_plane *primary;
 	struct wlr_drm_plane *cursor;
 
+	struct wlr_drm_plane **overlays;
+	size_t overlays_len;
+
 	union wlr_drm_crtc_props props;
 };
 
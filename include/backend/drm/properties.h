@@ -48,6 +48,7 @@ union wlr_drm_plane_props {
 		uint32_t type;
 		uint32_t rotation; // Not guaranteed to exist
 		uint32_t in_formats; // Not guaranteed to exist
+		uint32_t zpos; // Not guaranteed to exist
 
 		// atomic-modesetting only
 
@@ -62,8 +63,9 @@ union wlr_drm_plane_props {
 		uint32_t fb_id;
 		uint32_t crtc_id;
 		uint32_t fb_damage_clips;
+		uint32_t in_fence_fd;
 	};
-	uint32_t props[14];
+	uint32_t props[16];
 };
 
 bool get_drm_connector_props(int fd, uint32_t id,
@@ -74,5 +76,7 @@ bool get_drm_plane_props(int fd, uint32_t id, union wlr_drm_plane_props *out);
 bool get_drm_prop(int fd, uint32_t obj, uint32_t prop, uint64_t *ret);
 void *get_drm_prop_blob(int fd, uint32_t obj, uint32_t prop, size_t *ret_len);
 char *get_drm_prop_enum(int fd, uint32_t obj, uint32_t prop);
+bool get_drm_prop_range(int fd, uint32_t prop, uint64_t *min, uint64_t *max,
+	bool *immutable);
 
 #endif
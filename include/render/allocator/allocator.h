@@ -24,6 +24,12 @@ struct wlr_allocator {
 	struct {
 		struct wl_signal destroy;
 	} events;
+
+	// Cache of the underlying buffers of destroyed buffers, see
+	// wlr_allocator_set_cache_budget()
+	size_t cache_budget, cache_size; // in bytes
+	struct wl_list cache; // wlr_allocator_buffer.link, most recent first
+	struct wl_list buffers; // wlr_allocator_buffer.link, in use
 };
 
 /**
@@ -31,10 +37,25 @@ struct wlr_allocator {
  */
 struct wlr_allocator *wlr_allocator_autocreate(struct wlr_backend *backend,
 	struct wlr_renderer *renderer);
+/**
+ * Creates an allocator for buffers which are only rendered to and sampled
+ * from by the renderer, never displayed by a backend. Returns NULL if the
+ * renderer can't render to DMA-BUFs.
+ */
+struct wlr_allocator *allocator_autocreate_offscreen(
+	struct wlr_renderer *renderer);
 /**
  * Destroy the allocator.
  */
 void wlr_allocator_destroy(struct wlr_allocator *alloc);
+/**
+ * Set the amount of memory used to keep the underlying storage of destroyed
+ * buffers around. Allocating a buffer with the same size and format as a
+ * cached one re-uses it instead of allocating new storage. The least recently
+ * destroyed buffers are evicted first. Zero (the default) disables the cache.
+ */
+void wlr_allocator_set_cache_budget(struct wlr_allocator *alloc,
+	size_t budget);
 /**
  * Allocate a new buffer.
  *
@@ -4,15 +4,38 @@
 #include <wlr/types/wlr_buffer.h>
 #include "render/allocator/allocator.h"
 
+/**
+ * A shared memory file mapped once, from which multiple buffers are carved.
+ */
+struct wlr_shm_allocator_pool {
+	struct wlr_shm_allocator *allocator; // NULL if destroyed
+	struct wl_list link; // wlr_shm_allocator.pools
+
+	int fd;
+	void *data;
+	size_t size;
+
+	struct wl_array free_ranges; // struct wlr_shm_range, sorted by offset
+	size_t dirty_end; // memory past this offset has never been used
+	size_t buffers_len;
+};
+
+struct wlr_shm_range {
+	size_t offset, size;
+};
+
 struct wlr_shm_buffer {
 	struct wlr_buffer base;
 	struct wlr_shm_attributes shm;
+	struct wlr_shm_allocator_pool *pool;
 	void *data;
 	size_t size;
 };
 
 struct wlr_shm_allocator {
 	struct wlr_allocator base;
+
+	struct wl_list pools; // wlr_shm_allocator_pool.link
 };
 
 /**
@@ -48,6 +48,19 @@ bool wlr_egl_destroy_image(struct wlr_egl *egl, EGLImageKHR image);
 
 int wlr_egl_dup_drm_fd(struct wlr_egl *egl);
 
+/**
+ * Create a native fence sync signalled when the commands submitted so far are
+ * complete. The context must be current. Returns EGL_NO_SYNC_KHR on error or
+ * if EGL_ANDROID_native_fence_sync isn't supported.
+ */
+EGLSyncKHR wlr_egl_create_fence_sync(struct wlr_egl *egl);
+void wlr_egl_destroy_sync(struct wlr_egl *egl, EGLSyncKHR sync);
+/**
+ * Export a native fence sync as a sync_file. The fence must have been flushed.
+ * Returns -1 on error.
+ */
+int wlr_egl_dup_fence_fd(struct wlr_egl *egl, EGLSyncKHR sync);
+
 /**
  * Save the current EGL context to the structure provided in the argument.
  *
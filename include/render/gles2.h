@@ -21,14 +21,47 @@ struct wlr_gles2_pixel_format {
 	bool has_alpha;
 };
 
+// Vertex attribute locations, shared by all programs
+enum wlr_gles2_attrib {
+	WLR_GLES2_ATTRIB_POS = 0,
+	WLR_GLES2_ATTRIB_TEXCOORD = 1,
+	WLR_GLES2_ATTRIB_TEXCLAMP = 2,
+};
+
+// Vertex positions are transformed to clip space on the CPU side, so that
+// all quads of a frame can be uploaded at once
+struct wlr_gles2_vertex {
+	GLfloat x, y;
+	GLfloat u, v;
+	// Texture coordinates are clamped to half a texel inside the source box,
+	// so that linear filtering never samples texels outside of it (e.g. the
+	// neighbouring entries of a texture atlas)
+	GLfloat u_min, v_min, u_max, v_max;
+};
+
+// Number of staging buffers used for asynchronous texture uploads
+#define WLR_GLES2_STAGING_BUFFERS 8
+
+struct wlr_gles2_staging_buffer {
+	GLuint pbo;
+	GLsizeiptr size;
+	GLsync fence; // signalled once the GPU is done reading the buffer
+};
+
+// Number of frames which can be timed at once
+#define WLR_GLES2_TIMER_QUERIES 4
+
+struct wlr_gles2_timer_query {
+	GLuint begin, end; // timestamp queries
+	uint64_t render_seq;
+	bool pending; // waiting for the results
+};
+
 struct wlr_gles2_tex_shader {
 	GLuint program;
-	GLint proj;
-	GLint invert_y;
 	GLint tex;
 	GLint alpha;
-	GLint pos_attrib;
-	GLint tex_attrib;
+	GLfloat alpha_value; // last value set for the uniform
 };
 
 struct wlr_gles2_renderer {
@@ -46,6 +79,11 @@ struct wlr_gles2_renderer {
 		bool OES_egl_image;
 		bool EXT_texture_type_2_10_10_10_REV;
 		bool OES_texture_half_float_linear;
+		// Pixel unpack buffers, buffer mapping and fences, either from GLES
+		// 3.0 or from extensions
+		bool staged_upload;
+		// GL_EXT_disjoint_timer_query, with timestamp support
+		bool EXT_disjoint_timer_query;
 	} exts;
 
 	struct {
@@ -55,14 +93,25 @@ struct wlr_gles2_renderer {
 		PFNGLPOPDEBUGGROUPKHRPROC glPopDebugGroupKHR;
 		PFNGLPUSHDEBUGGROUPKHRPROC glPushDebugGroupKHR;
 		PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC glEGLImageTargetRenderbufferStorageOES;
+		// The following may point to the GLES 3.0 core functions
+		PFNGLMAPBUFFERRANGEEXTPROC glMapBufferRangeEXT;
+		PFNGLUNMAPBUFFEROESPROC glUnmapBufferOES;
+		PFNGLFENCESYNCAPPLEPROC glFenceSyncAPPLE;
+		PFNGLCLIENTWAITSYNCAPPLEPROC glClientWaitSyncAPPLE;
+		PFNGLDELETESYNCAPPLEPROC glDeleteSyncAPPLE;
+		PFNGLGENQUERIESEXTPROC glGenQueriesEXT;
+		PFNGLDELETEQUERIESEXTPROC glDeleteQueriesEXT;
+		PFNGLQUERYCOUNTEREXTPROC glQueryCounterEXT;
+		PFNGLGETQUERYIVEXTPROC glGetQueryivEXT;
+		PFNGLGETQUERYOBJECTIVEXTPROC glGetQueryObjectivEXT;
+		PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64vEXT;
 	} procs;
 
 	struct {
 		struct {
 			GLuint program;
-			GLint proj;
 			GLint color;
-			GLint pos_attrib;
+			GLfloat color_value[4]; // last value set for the uniform
 		} quad;
 		struct wlr_gles2_tex_shader tex_rgba;
 		struct wlr_gles2_tex_shader tex_rgbx;
@@ -74,6 +123,25 @@ struct wlr_gles2_renderer {
 
 	struct wlr_gles2_buffer *current_buffer;
 	uint32_t viewport_width, viewport_height;
+
+	struct wlr_gles2_staging_buffer staging[WLR_GLES2_STAGING_BUFFERS];
+	size_t staging_next;
+	struct wlr_gles2_upload_stats upload_stats;
+
+	struct wlr_gles2_timer_query timer_queries[WLR_GLES2_TIMER_QUERIES];
+	size_t timer_query_next;
+
+	GLuint vbo; // streaming vertex buffer
+	struct wl_array vertices; // struct wlr_gles2_vertex, pending upload
+
+	// GL state last set by the renderer, used to skip redundant calls. Reset
+	// by each drawing entry point.
+	struct {
+		GLuint program;
+		GLenum tex_target;
+		GLuint tex;
+		bool blend;
+	} state;
 };
 
 struct wlr_gles2_buffer {
@@ -131,6 +199,9 @@ struct wlr_texture *gles2_texture_from_buffer(struct wlr_renderer *wlr_renderer,
 	struct wlr_buffer *buffer);
 void gles2_texture_destroy(struct wlr_gles2_texture *texture);
 
+void gles2_bind_texture(struct wlr_gles2_renderer *renderer, GLenum target,
+	GLuint tex);
+
 void push_gles2_debug_(struct wlr_gles2_renderer *renderer,
 	const char *file, const char *func);
 #define push_gles2_debug(renderer) push_gles2_debug_(renderer, _WLR_FILENAME, __func__)
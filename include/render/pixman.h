@@ -4,6 +4,7 @@
 #include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/render/drm_format_set.h>
+#include <wlr/util/box.h>
 #include "render/pixel_format.h"
 
 struct wlr_pixman_pixel_format {
@@ -12,6 +13,27 @@ struct wlr_pixman_pixel_format {
 };
 
 struct wlr_pixman_buffer;
+struct wlr_pixman_workers;
+
+/**
+ * A drawing operation recorded in threaded mode.
+ */
+struct wlr_pixman_command {
+	pixman_op_t op;
+	struct wlr_box box; // destination area
+
+	// Source pixels, or NULL for a solid fill with color
+	pixman_image_t *src; // reference keeping the pixels alive
+	pixman_format_code_t src_format;
+	uint32_t *src_bits;
+	int src_width, src_height, src_stride;
+	int src_x, src_y; // source position of the destination origin
+	struct pixman_transform transform;
+	bool has_transform;
+	uint16_t mask_alpha; // 0xFFFF if no mask is needed
+
+	pixman_color_t color;
+};
 
 struct wlr_pixman_renderer {
 	struct wlr_renderer wlr_renderer;
@@ -21,6 +43,18 @@ struct wlr_pixman_renderer {
 
 	struct wlr_pixman_buffer *current_buffer;
 	int32_t width, height;
+	struct wlr_box scissor; // area of the buffer which can be modified
+
+	// Solid masks applying an alpha multiplier, by 8-bit alpha value
+	pixman_image_t *alpha_masks[0xFF];
+
+	// Threaded mode, see WLR_PIXMAN_THREADS. Drawing operations are recorded
+	// and executed in parallel when rendering ends.
+	struct wlr_pixman_workers *workers; // NULL if disabled
+	struct wl_array commands; // struct wlr_pixman_command
+	struct wl_array accessed_textures; // struct wlr_pixman_texture *
+
+	struct wlr_pixman_image_stats image_stats;
 
 	struct wlr_drm_format_set drm_formats;
 };
@@ -46,10 +80,26 @@ struct wlr_pixman_texture {
 
 	void *data; // if created via texture_from_pixels
 	struct wlr_buffer *buffer; // if created via texture_from_buffer
+
+	bool accessed; // data is accessed until the recorded commands are run
 };
 
 pixman_format_code_t get_pixman_format_from_drm(uint32_t fmt);
 uint32_t get_drm_format_from_pixman(pixman_format_code_t fmt);
 const uint32_t *get_pixman_drm_formats(size_t *len);
 
+/**
+ * Start a pool of worker threads compositing in parallel.
+ */
+struct wlr_pixman_workers *pixman_workers_create(size_t threads_len);
+void pixman_workers_destroy(struct wlr_pixman_workers *workers);
+/**
+ * Run the commands on the destination image. The area touched by the
+ * commands is split into tiles, which are composited in parallel by the
+ * worker threads and the calling thread. Returns when all tiles are done.
+ */
+void pixman_workers_run(struct wlr_pixman_workers *workers,
+	pixman_image_t *dest, const struct wlr_pixman_command *commands,
+	size_t commands_len);
+
 #endif
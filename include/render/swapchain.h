@@ -2,15 +2,19 @@
 #define RENDER_SWAPCHAIN_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 #include <wlr/render/drm_format_set.h>
 
 #define WLR_SWAPCHAIN_CAP 4
+// Time in milliseconds after which an unused buffer is released
+#define WLR_SWAPCHAIN_IDLE_MS 2000
 
 struct wlr_swapchain_slot {
 	struct wlr_buffer *buffer;
 	bool acquired; // waiting for release
 	int age;
+	int64_t last_used; // CLOCK_MONOTONIC time in ms when last acquired
 
 	struct wl_listener release;
 };
@@ -22,6 +26,14 @@ struct wlr_swapchain {
 	struct wlr_drm_format *format;
 
 	struct wlr_swapchain_slot slots[WLR_SWAPCHAIN_CAP];
+	size_t capacity; // number of usable slots, at most WLR_SWAPCHAIN_CAP
+
+	struct {
+		uint64_t allocations; // buffers allocated
+		uint64_t reuses; // acquires which didn't need an allocation
+		uint64_t starvations; // acquires which failed for lack of a slot
+		uint64_t trims; // idle buffers released
+	} stats;
 
 	struct wl_listener allocator_destroy;
 };
@@ -30,6 +42,26 @@ struct wlr_swapchain *wlr_swapchain_create(
 	struct wlr_allocator *alloc, int width, int height,
 	const struct wlr_drm_format *format);
 void wlr_swapchain_destroy(struct wlr_swapchain *swapchain);
+/**
+ * Set the maximum number of buffers in the swap chain, between 1 and
+ * WLR_SWAPCHAIN_CAP. Buffers in excess are released as soon as they're not
+ * in use anymore.
+ *
+ * A capacity of 1 only suits users which wait for the buffer to be released
+ * before acquiring the next one. Outputs keep their front buffer while
+ * rendering the next frame and need at least 2, see
+ * wlr_output_set_swapchain_depth().
+ */
+void wlr_swapchain_set_capacity(struct wlr_swapchain *swapchain,
+	size_t capacity);
+/**
+ * Release the buffers which aren't in use and either haven't been acquired
+ * during the last WLR_SWAPCHAIN_IDLE_MS, or are in excess of the capacity.
+ *
+ * This is done on each submission. Users which may stop submitting buffers
+ * should call it once they're idle, so that unused buffers are released.
+ */
+void wlr_swapchain_trim(struct wlr_swapchain *swapchain);
 /**
  * Acquire a buffer from the swap chain.
  *
@@ -42,6 +74,8 @@ struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
  * Mark the buffer as submitted for presentation. This needs to be called by
  * swap chain users on frame boundaries.
  *
+ * Idle buffers are released, see wlr_swapchain_trim().
+ *
  * If the buffer hasn't been created via the swap chain, the call is ignored.
  */
 void wlr_swapchain_set_buffer_submitted(struct wlr_swapchain *swapchain,
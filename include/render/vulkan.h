@@ -56,6 +56,10 @@ struct wlr_vk_device {
 	uint32_t queue_family;
 	VkQueue queue;
 
+	// zero if the queue doesn't support timestamps
+	uint32_t timestamp_valid_bits;
+	float timestamp_period; // nanoseconds per timestamp tick
+
 	struct {
 		PFN_vkGetMemoryFdPropertiesKHR getMemoryFdPropertiesKHR;
 	} api;
@@ -170,6 +174,10 @@ struct wlr_vk_renderer {
 
 	VkFence fence;
 
+	// begin and end timestamps of the current frame, if supported
+	VkQueryPool timestamp_pool;
+	bool timestamps_written;
+
 	struct wlr_vk_render_buffer *current_render_buffer;
 
 	// current frame id. Used in wlr_vk_texture.last_used
@@ -178,13 +186,17 @@ struct wlr_vk_renderer {
 	VkRect2D scissor; // needed for clearing
 
 	VkCommandBuffer cb;
+	// State bound in cb, used to skip redundant commands
 	VkPipeline bound_pipe;
+	VkDescriptorSet bound_ds;
+	float frag_pcr[4]; // last fragment push constants
+	uint32_t frag_pcr_size; // zero if unknown
 
 	uint32_t render_width;
 	uint32_t render_height;
 	float projection[9];
 
-	size_t last_pool_size;
+	size_t last_pool_size; // size of the most recently created pool
 	struct wl_list descriptor_pools; // type wlr_vk_descriptor_pool
 	struct wl_list render_format_setups;
 
@@ -283,6 +295,7 @@ struct wlr_vk_shared_buffer {
 	VkBuffer buffer;
 	VkDeviceMemory memory;
 	VkDeviceSize buf_size;
+	uint32_t last_used; // frame of the last allocation
 
 	size_t allocs_size;
 	size_t allocs_capacity;
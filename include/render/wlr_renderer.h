@@ -15,6 +15,14 @@ struct wlr_renderer *renderer_autocreate_with_drm_fd(int drm_fd);
  * calling renderer_bind_buffer with a NULL buffer.
  */
 bool renderer_bind_buffer(struct wlr_renderer *r, struct wlr_buffer *buffer);
+/**
+ * Start rendering to a buffer on behalf of wlroots itself, e.g. to copy a
+ * client buffer. Unlike wlr_renderer_begin_with_buffer(), this doesn't
+ * advance wlr_renderer.render_seq and isn't reported via the timing event,
+ * which only covers the compositor's frames. Ended with wlr_renderer_end().
+ */
+bool renderer_begin_internal_with_buffer(struct wlr_renderer *r,
+	struct wlr_buffer *buffer);
 /**
  * Get the supported render formats. Buffers allocated with a format from this
  * list may be attached via wlr_renderer_begin_with_buffer.
@@ -27,5 +35,11 @@ const struct wlr_drm_format_set *wlr_renderer_get_render_formats(
  * This functions returns a bitfield of supported wlr_buffer_cap.
  */
 uint32_t renderer_get_render_buffer_caps(struct wlr_renderer *renderer);
+/**
+ * Check whether two batched quads can share their draw state, i.e. whether
+ * they only differ by their clip box.
+ */
+bool render_quads_share_state(const struct wlr_render_quad *a,
+	const struct wlr_render_quad *b);
 
 #endif
@@ -69,4 +69,15 @@ struct wlr_dmabuf_buffer *dmabuf_buffer_create(
  */
 bool dmabuf_buffer_drop(struct wlr_dmabuf_buffer *buffer);
 
+struct wlr_allocator;
+
+/**
+ * Creates a wlr_client_buffer holding a copy of a DMA-BUF buffer's contents,
+ * made by the renderer into a buffer allocated with the allocator. The texture
+ * samples from the copy, so later buffers can be applied by copying only
+ * their damaged regions with wlr_client_buffer_apply_damage().
+ */
+struct wlr_client_buffer *client_buffer_create_copy(struct wlr_buffer *buffer,
+	struct wlr_renderer *renderer, struct wlr_allocator *allocator);
+
 #endif
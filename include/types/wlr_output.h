@@ -10,6 +10,16 @@ void output_pending_resolution(struct wlr_output *output, int *width,
 struct wlr_drm_format *output_pick_format(struct wlr_output *output,
 	const struct wlr_drm_format_set *display_formats);
 void output_clear_back_buffer(struct wlr_output *output);
+/**
+ * Attach a fence signalled when rendering to the back buffer completes to the
+ * pending state, unless the compositor has already set one.
+ */
+void output_export_render_fence(struct wlr_output *output);
 bool output_ensure_buffer(struct wlr_output *output);
+/**
+ * Release the swapchain buffers which remain unused once the output stops
+ * submitting new ones. Called after each submission.
+ */
+void output_schedule_swapchain_trim(struct wlr_output *output);
 
 #endif
@@ -3,13 +3,17 @@
 
 #include <wlr/types/wlr_surface.h>
 
+struct wlr_allocator;
 struct wlr_renderer;
 
 /**
- * Create a new surface resource with the provided new ID.
+ * Create a new surface resource with the provided new ID. The allocator is
+ * optional, and used to keep copies of DMA-BUF client buffers updated with
+ * the damaged regions only.
  */
 struct wlr_surface *surface_create(struct wl_client *client,
-	uint32_t version, uint32_t id, struct wlr_renderer *renderer);
+	uint32_t version, uint32_t id, struct wlr_renderer *renderer,
+	struct wlr_allocator *allocator);
 
 /**
  * Create a new subsurface resource with the provided new ID.
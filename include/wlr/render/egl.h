@@ -40,6 +40,7 @@ struct wlr_egl {
 		bool KHR_image_base;
 		bool EXT_image_dma_buf_import;
 		bool EXT_image_dma_buf_import_modifiers;
+		bool ANDROID_native_fence_sync;
 
 		// Device extensions
 		bool EXT_device_drm;
@@ -62,6 +63,9 @@ struct wlr_egl {
 		PFNEGLQUERYDISPLAYATTRIBEXTPROC eglQueryDisplayAttribEXT;
 		PFNEGLQUERYDEVICESTRINGEXTPROC eglQueryDeviceStringEXT;
 		PFNEGLQUERYDEVICESEXTPROC eglQueryDevicesEXT;
+		PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR;
+		PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR;
+		PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID;
 	} procs;
 
 	struct wlr_drm_format_set dmabuf_texture_formats;
@@ -10,6 +10,7 @@
 #define WLR_RENDER_GLES2_H
 
 #include <GLES2/gl2.h>
+#include <stdint.h>
 #include <wlr/backend.h>
 #include <wlr/render/wlr_renderer.h>
 
@@ -23,9 +24,30 @@ bool wlr_gles2_renderer_check_ext(struct wlr_renderer *renderer,
 	const char *ext);
 /**
  * Returns the OpenGL FBO of current buffer.
+ *
+ * Compositors may issue their own GL calls inside a rendering block, between
+ * wlr_render_* calls. The renderer sets up the GL state it relies on again
+ * on each of these calls, except for the bound framebuffer, the viewport and
+ * the uniforms of its own programs.
  */
 GLuint wlr_gles2_renderer_get_current_fbo(struct wlr_renderer *wlr_renderer);
 
+struct wlr_gles2_upload_stats {
+	uint64_t uploads; // number of texture uploads
+	uint64_t bytes; // total bytes uploaded
+	// Part of the above which went through staging buffers, copied to the
+	// texture asynchronously by the GPU
+	uint64_t staged_uploads, staged_bytes;
+};
+
+/**
+ * Get the number of uploads and bytes uploaded to textures since the renderer
+ * was created. Compositors can sample the counters every frame to compute
+ * per-frame statistics.
+ */
+void wlr_gles2_renderer_get_upload_stats(struct wlr_renderer *renderer,
+	struct wlr_gles2_upload_stats *stats);
+
 struct wlr_gles2_texture_attribs {
 	GLenum target; /* either GL_TEXTURE_2D or GL_TEXTURE_EXTERNAL_OES */
 	GLuint tex;
@@ -32,6 +32,8 @@ struct wlr_renderer_impl {
 		const float matrix[static 9], float alpha);
 	void (*render_quad_with_matrix)(struct wlr_renderer *renderer,
 		const float color[static 4], const float matrix[static 9]);
+	bool (*render_quads)(struct wlr_renderer *renderer,
+		const struct wlr_render_quad *quads, size_t quads_len);
 	const uint32_t *(*get_shm_texture_formats)(
 		struct wlr_renderer *renderer, size_t *len);
 	const struct wlr_drm_format_set *(*get_dmabuf_texture_formats)(
@@ -48,10 +50,24 @@ struct wlr_renderer_impl {
 	uint32_t (*get_render_buffer_caps)(struct wlr_renderer *renderer);
 	struct wlr_texture *(*texture_from_buffer)(struct wlr_renderer *renderer,
 		struct wlr_buffer *buffer);
+	// Optional timing queries, only used while the timing event has
+	// listeners. begin_timing is called right after begin, and end_timing
+	// right before end if begin_timing returned true. The results are
+	// reported via wlr_renderer_emit_timing(). Otherwise, the CPU time
+	// between begin and end is reported.
+	bool (*begin_timing)(struct wlr_renderer *renderer);
+	void (*end_timing)(struct wlr_renderer *renderer);
+	// Optional, see wlr_renderer_export_sync_file()
+	int (*export_sync_file)(struct wlr_renderer *renderer);
 };
 
 void wlr_renderer_init(struct wlr_renderer *renderer,
 	const struct wlr_renderer_impl *impl);
+/**
+ * Report the time taken to render the frame with the given sequence number.
+ */
+void wlr_renderer_emit_timing(struct wlr_renderer *renderer,
+	uint64_t render_seq, uint64_t begin_ns, uint64_t end_ns);
 
 struct wlr_texture_impl {
 	bool (*is_opaque)(struct wlr_texture *texture);
@@ -10,6 +10,7 @@
 #define WLR_RENDER_PIXMAN_H
 
 #include <pixman.h>
+#include <stdint.h>
 #include <wlr/backend.h>
 #include <wlr/render/wlr_renderer.h>
 
@@ -20,6 +21,20 @@ struct wlr_renderer *wlr_pixman_renderer_create(void);
 pixman_image_t *wlr_pixman_renderer_get_current_image(
 	struct wlr_renderer *wlr_renderer);
 
+struct wlr_pixman_image_stats {
+	uint64_t accesses; // buffer data accesses by the renderer
+	// Accesses which had to re-create the pixman image wrapping the buffer,
+	// because the buffer's memory was remapped
+	uint64_t recreated;
+};
+
+/**
+ * Get the number of buffer accesses and pixman image re-creations since the
+ * renderer was created.
+ */
+void wlr_pixman_renderer_get_image_stats(struct wlr_renderer *renderer,
+	struct wlr_pixman_image_stats *stats);
+
 bool wlr_renderer_is_pixman(struct wlr_renderer *wlr_renderer);
 bool wlr_texture_is_pixman(struct wlr_texture *texture);
 pixman_image_t *wlr_pixman_texture_get_image(struct wlr_texture *wlr_texture);
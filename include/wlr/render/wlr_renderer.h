@@ -13,6 +13,7 @@
 #include <wayland-server-core.h>
 #include <wlr/backend.h>
 #include <wlr/render/wlr_texture.h>
+#include <wlr/util/box.h>
 
 enum wlr_renderer_read_pixels_flags {
 	WLR_RENDERER_READ_PIXELS_Y_INVERT = 1,
@@ -21,8 +22,6 @@ enum wlr_renderer_read_pixels_flags {
 struct wlr_renderer_impl;
 struct wlr_drm_format_set;
 struct wlr_buffer;
-struct wlr_box;
-struct wlr_fbox;
 
 struct wlr_renderer {
 	const struct wlr_renderer_impl *impl;
@@ -30,9 +29,51 @@ struct wlr_renderer {
 	bool rendering;
 	bool rendering_with_buffer;
 
+	// Sequence number of the current or last wlr_renderer_begin/end pair.
+	// Rendering done internally by wlroots, e.g. to copy buffers, isn't
+	// counted.
+	uint64_t render_seq;
+
 	struct {
 		struct wl_signal destroy;
+		struct wl_signal timing; // struct wlr_renderer_timing_event
 	} events;
+
+	// private state
+
+	bool timing; // the current frame is being timed
+	bool timing_by_impl; // the implementation reports the timing
+	uint64_t timing_begin_ns;
+};
+
+/**
+ * Time taken to render a frame, emitted when the results are available. For
+ * GPU renderers, this may be a few frames after wlr_renderer_end().
+ *
+ * Frames are only timed while the timing event has listeners.
+ */
+struct wlr_renderer_timing_event {
+	struct wlr_renderer *renderer;
+	uint64_t render_seq; // see wlr_renderer.render_seq
+	// Start and end of the rendering work, in nanoseconds. For GPU renderers
+	// these are GPU timestamps, only their difference is meaningful.
+	// Otherwise, these are CPU timestamps from CLOCK_MONOTONIC.
+	uint64_t begin_ns, end_ns;
+};
+
+/**
+ * A quad submitted as part of a batch, see wlr_render_quads().
+ */
+struct wlr_render_quad {
+	// Texture to sample from, or NULL to fill the quad with a solid color
+	struct wlr_texture *texture;
+	struct wlr_fbox src_box; // for textured quads
+	float alpha; // for textured quads
+	float color[4]; // for solid quads
+	float matrix[9];
+	// Only pixels inside this box can be modified, in the same coordinate
+	// space as wlr_renderer_scissor()
+	struct wlr_box clip;
 };
 
 struct wlr_renderer *wlr_renderer_autocreate(struct wlr_backend *backend);
@@ -75,6 +116,17 @@ void wlr_render_rect(struct wlr_renderer *r, const struct wlr_box *box,
  */
 void wlr_render_quad_with_matrix(struct wlr_renderer *r,
 	const float color[static 4], const float matrix[static 9]);
+/**
+ * Renders a batch of quads, in order. Each quad is clipped to its own clip
+ * box, which replaces the scissor box. The scissor box is disabled afterwards.
+ *
+ * Consecutive quads which only differ by their clip box share their draw
+ * state, so splitting a quad into one entry per damaged rectangle is cheap.
+ *
+ * Returns false if a quad failed to render.
+ */
+bool wlr_render_quads(struct wlr_renderer *r,
+	const struct wlr_render_quad *quads, size_t quads_len);
 /**
  * Get the shared-memory formats supporting import usage. Buffers allocated
  * with a format from this list may be imported via wlr_texture_from_pixels.
@@ -113,6 +165,17 @@ bool wlr_renderer_init_wl_display(struct wlr_renderer *r,
  */
 int wlr_renderer_get_drm_fd(struct wlr_renderer *r);
 
+/**
+ * Export a sync_file signalled when the rendering operations submitted so far
+ * (e.g. up to the last wlr_renderer_end() call) have completed. This allows
+ * consumers of the rendered buffer to wait for rendering to finish without
+ * stalling the CPU.
+ *
+ * Returns -1 if the renderer doesn't support this, or if rendering completes
+ * before wlr_renderer_end() returns. The caller takes ownership of the FD.
+ */
+int wlr_renderer_export_sync_file(struct wlr_renderer *r);
+
 /**
  * Destroys this wlr_renderer. Textures must be destroyed separately.
  */
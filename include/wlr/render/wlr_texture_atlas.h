@@ -0,0 +1,75 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_RENDER_WLR_TEXTURE_ATLAS_H
+#define WLR_RENDER_WLR_TEXTURE_ATLAS_H
+
+#include <stdbool.h>
+#include <wayland-server-core.h>
+#include <wlr/util/box.h>
+
+struct wlr_buffer;
+struct wlr_renderer;
+struct wlr_texture;
+
+/**
+ * A texture atlas packs the contents of small buffers into a few large
+ * textures, so that drawing many of them doesn't require switching textures.
+ *
+ * Only buffers supporting data pointer access and whose contents never change
+ * (e.g. cursor images or decorations created by the compositor) are suitable
+ * for the atlas: the contents are copied once, when the buffer is first added.
+ * The entry is released when the buffer is destroyed.
+ */
+struct wlr_texture_atlas {
+	struct wlr_renderer *renderer;
+
+	// private state
+
+	struct wl_list pages; // struct atlas_page.link
+	bool disabled; // the renderer's textures can't be updated
+};
+
+/**
+ * Create a texture atlas for the renderer. The atlas must be destroyed before
+ * the renderer.
+ */
+struct wlr_texture_atlas *wlr_texture_atlas_create(
+	struct wlr_renderer *renderer);
+/**
+ * Destroy the atlas and all of its textures.
+ */
+void wlr_texture_atlas_destroy(struct wlr_texture_atlas *atlas);
+/**
+ * Get the atlas texture containing the buffer, adding the buffer to the atlas
+ * if it isn't already part of it. The area of the texture occupied by the
+ * buffer is returned in `box`.
+ *
+ * Returns NULL if the buffer can't be added to the atlas, e.g. because it is
+ * too large or doesn't support data pointer access. In that case, the caller
+ * should fall back to wlr_texture_from_buffer().
+ *
+ * Should not be called in a rendering block like renderer_begin()/end() or
+ * between attaching a renderer to an output and committing it.
+ */
+struct wlr_texture *wlr_texture_atlas_get_buffer(
+	struct wlr_texture_atlas *atlas, struct wlr_buffer *buffer,
+	struct wlr_box *box);
+/**
+ * Get the atlas texture containing the buffer, if the buffer has already been
+ * added to the atlas. The area of the texture occupied by the buffer is
+ * returned in `box`. Returns NULL otherwise.
+ *
+ * This function doesn't modify the atlas, so contrary to
+ * wlr_texture_atlas_get_buffer() it can be called in a rendering block.
+ */
+struct wlr_texture *wlr_texture_atlas_find_buffer(
+	struct wlr_texture_atlas *atlas, struct wlr_buffer *buffer,
+	struct wlr_box *box);
+
+#endif
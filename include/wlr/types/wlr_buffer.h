@@ -186,6 +186,11 @@ struct wlr_client_buffer {
 
 	// If the client buffer has been created from a wl_shm buffer
 	uint32_t shm_source_format;
+
+	// If the texture samples from a compositor-owned copy of the source
+	// contents instead of the source itself
+	struct wlr_buffer *copy;
+	struct wlr_renderer *renderer;
 };
 
 /**
@@ -207,6 +212,10 @@ bool wlr_resource_is_buffer(struct wl_resource *resource);
 /**
  * Try to update the buffer's content.
  *
+ * For wl_shm buffers, the damaged regions are uploaded to the texture. For
+ * client buffers holding a copy of a DMA-BUF, the damaged regions are copied
+ * from the next buffer by the renderer. In both cases, the texture is kept.
+ *
  * Fails if there's more than one reference to the buffer or if the texture
  * isn't mutable.
  */
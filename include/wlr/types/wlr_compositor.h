@@ -12,6 +12,7 @@
 #include <wayland-server-core.h>
 #include <wlr/render/wlr_renderer.h>
 
+struct wlr_allocator;
 struct wlr_surface;
 
 struct wlr_subcompositor {
@@ -30,11 +31,32 @@ struct wlr_compositor {
 		struct wl_signal new_surface;
 		struct wl_signal destroy;
 	} events;
+
+	// private state
+
+	// Allocates the compositor-owned copies of client buffers, NULL unless
+	// enabled with wlr_compositor_enable_buffer_copies()
+	struct wlr_allocator *allocator;
 };
 
 struct wlr_compositor *wlr_compositor_create(struct wl_display *display,
 	struct wlr_renderer *renderer);
 
+/**
+ * Keep compositor-owned copies of DMA-BUF client buffers, updated with the
+ * damaged regions only, instead of importing each new buffer. This keeps the
+ * surface textures stable and lets clients re-use their buffers sooner, at
+ * the cost of a GPU copy of the damaged regions on each commit. Copies are
+ * only made for surfaces with small damage, and never while the surface's
+ * buffer is displayed by an output (e.g. via direct scan-out), so that
+ * zero-copy scan-out keeps working.
+ *
+ * Disabled by default. Only affects surfaces created afterwards, so this
+ * should be called right after wlr_compositor_create(). Returns false if the
+ * renderer can't render to DMA-BUFs.
+ */
+bool wlr_compositor_enable_buffer_copies(struct wlr_compositor *compositor);
+
 bool wlr_surface_is_subsurface(struct wlr_surface *surface);
 
 /**
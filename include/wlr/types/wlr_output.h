@@ -17,6 +17,7 @@
 #include <wlr/render/dmabuf.h>
 #include <wlr/types/wlr_buffer.h>
 #include <wlr/util/addon.h>
+#include <wlr/util/box.h>
 
 struct wlr_output_mode {
 	int32_t width, height;
@@ -62,6 +63,8 @@ enum wlr_output_state_field {
 	WLR_OUTPUT_STATE_TRANSFORM = 1 << 5,
 	WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED = 1 << 6,
 	WLR_OUTPUT_STATE_GAMMA_LUT = 1 << 7,
+	WLR_OUTPUT_STATE_OVERLAYS = 1 << 8,
+	WLR_OUTPUT_STATE_IN_FENCE = 1 << 9,
 };
 
 enum wlr_output_state_mode_type {
@@ -69,6 +72,15 @@ enum wlr_output_state_mode_type {
 	WLR_OUTPUT_STATE_MODE_CUSTOM,
 };
 
+/**
+ * A buffer displayed by the output hardware on top of the primary buffer,
+ * for instance via a KMS overlay plane.
+ */
+struct wlr_output_overlay {
+	struct wlr_buffer *buffer;
+	struct wlr_box dst_box; // output-buffer-local coordinates
+};
+
 /**
  * Holds the double-buffered output state.
  */
@@ -83,6 +95,9 @@ struct wlr_output_state {
 	// only valid if WLR_OUTPUT_STATE_BUFFER
 	struct wlr_buffer *buffer;
 
+	// only valid if WLR_OUTPUT_STATE_IN_FENCE
+	int in_fence_fd; // sync_file
+
 	// only valid if WLR_OUTPUT_STATE_MODE
 	enum wlr_output_state_mode_type mode_type;
 	struct wlr_output_mode *mode;
@@ -94,6 +109,10 @@ struct wlr_output_state {
 	// only valid if WLR_OUTPUT_STATE_GAMMA_LUT
 	uint16_t *gamma_lut;
 	size_t gamma_lut_size;
+
+	// only valid if WLR_OUTPUT_STATE_OVERLAYS
+	const struct wlr_output_overlay *overlays;
+	size_t overlays_len;
 };
 
 struct wlr_output_impl;
@@ -184,7 +203,10 @@ struct wlr_output {
 	int software_cursor_locks; // number of locks forcing software cursors
 
 	struct wlr_swapchain *swapchain;
+	size_t swapchain_depth; // zero for the default
+	struct wl_event_source *swapchain_trim_timer;
 	struct wlr_buffer *back_buffer, *front_buffer;
+	size_t overlays_len; // number of overlays currently displayed
 
 	struct wl_listener display_destroy;
 
@@ -193,6 +215,14 @@ struct wlr_output {
 	void *data;
 };
 
+struct wlr_output_swapchain_stats {
+	size_t buffers; // currently allocated
+	uint64_t allocations; // buffers allocated
+	uint64_t reuses; // frames which could reuse a previously allocated buffer
+	uint64_t starvations; // frames which failed because all buffers were busy
+	uint64_t trims; // idle buffers released
+};
+
 struct wlr_output_event_damage {
 	struct wlr_output *output;
 	pixman_region32_t *damage; // output-buffer-local coordinates
@@ -304,6 +334,24 @@ void wlr_output_set_scale(struct wlr_output *output, float scale);
 void wlr_output_set_subpixel(struct wlr_output *output,
 	enum wl_output_subpixel subpixel);
 void wlr_output_set_description(struct wlr_output *output, const char *desc);
+/**
+ * Set the maximum number of buffers used to render the output: 2 for double
+ * buffering, 3 for triple buffering, etc. Lower values use less memory, higher
+ * values allow rendering a new frame while more previous ones are in flight.
+ * Zero restores the default (4). The output keeps displaying its front buffer
+ * while the next frame is rendered, so the minimum is 2.
+ *
+ * Buffers which stay unused for a while are released regardless, including
+ * once the output stops committing new frames, so this is only an upper
+ * bound.
+ */
+void wlr_output_set_swapchain_depth(struct wlr_output *output, size_t depth);
+/**
+ * Get statistics about the output's render buffers. The counters are reset
+ * when the buffers need to be re-created, e.g. when the mode changes.
+ */
+void wlr_output_get_swapchain_stats(struct wlr_output *output,
+	struct wlr_output_swapchain_stats *stats);
 /**
  * Schedule a done event.
  *
@@ -348,6 +396,34 @@ void wlr_output_attach_buffer(struct wlr_output *output,
  * This function might change the current rendering context.
  */
 uint32_t wlr_output_preferred_read_format(struct wlr_output *output);
+/**
+ * Set the buffers displayed on top of the primary buffer. Overlays must not
+ * overlap each other. The array must remain valid until the output is
+ * committed or rolled back. An empty array disables all overlays. Overlays
+ * can only be set along with a new primary buffer.
+ *
+ * Not all backends support overlays, and backends which do only support a
+ * limited number of them. Compositors can check whether a configuration is
+ * supported by calling `wlr_output_test`.
+ *
+ * Overlays are double-buffered state, see `wlr_output_commit`. Commits which
+ * don't set overlays leave the current ones untouched. Setting an empty array
+ * while no overlays are displayed is a no-op.
+ */
+void wlr_output_set_overlays(struct wlr_output *output,
+	const struct wlr_output_overlay *overlays, size_t overlays_len);
+/**
+ * Set a sync_file signalled when the pending buffer is ready to be displayed,
+ * e.g. when the GPU has finished rendering to it. The output doesn't take
+ * ownership of the FD. The fence is reset when the pending buffer changes.
+ *
+ * Buffers rendered with wlr_output_attach_render() get a fence from the
+ * renderer when supported. Backends which don't support explicit
+ * synchronization rely on implicit synchronization instead.
+ *
+ * The fence is double-buffered state, see `wlr_output_commit`.
+ */
+void wlr_output_set_in_fence(struct wlr_output *output, int fd);
 /**
  * Set the damage region for the frame to be submitted. This is the region of
  * the screen that has changed since the last frame.
@@ -20,11 +20,13 @@
  */
 
 #include <pixman.h>
+#include <time.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_surface.h>
 
 struct wlr_output;
 struct wlr_output_layout;
+struct wlr_texture_atlas;
 
 enum wlr_scene_node_type {
 	WLR_SCENE_NODE_ROOT,
@@ -54,6 +56,17 @@ struct wlr_scene_node {
 	} events;
 
 	void *data;
+
+	// private state
+
+	// Bounding box of the node and all of its enabled descendants, relative
+	// to the node's position. Lazily re-computed when bounds_dirty is set.
+	struct wlr_box bounds;
+	bool bounds_dirty;
+	// Exact area covered by the same nodes, only computed when the node is
+	// damaged as a whole. Lazily re-computed when region_dirty is set.
+	pixman_region32_t region;
+	bool region_dirty;
 };
 
 /** The root scene-graph node. */
@@ -61,11 +74,28 @@ struct wlr_scene {
 	struct wlr_scene_node node;
 
 	struct wl_list outputs; // wlr_scene_output.link
+
+	// private state
+
+	// Frame callbacks of hidden surfaces, see
+	// wlr_scene_set_hidden_frame_interval()
+	int hidden_frame_interval_ms;
+	struct timespec last_hidden_frame_done;
+	struct wl_list hidden_surfaces; // wlr_scene_surface.hidden_link
+
+	// Optional, see wlr_scene_set_texture_atlas()
+	struct wlr_texture_atlas *texture_atlas;
 };
 
 /** A sub-tree in the scene-graph. */
 struct wlr_scene_tree {
 	struct wlr_scene_node node;
+
+	// private state
+
+	// Rendering of the descendants, see wlr_scene_tree_set_cached()
+	bool cached;
+	struct wl_list caches; // scene_tree_cache.link
 };
 
 /** A scene-graph node displaying a single surface. */
@@ -77,6 +107,12 @@ struct wlr_scene_surface {
 
 	struct wl_listener surface_destroy;
 	struct wl_listener surface_commit;
+
+	// Outputs on which the surface was visible when they were last
+	// committed, bitmask of wlr_scene_output.index
+	uint64_t visible_outputs;
+	// Link in wlr_scene.hidden_surfaces while visible_outputs is zero
+	struct wl_list hidden_link;
 };
 
 /** A scene-graph node displaying a solid-colored rectangle */
@@ -97,6 +133,9 @@ struct wlr_scene_buffer {
 	struct wlr_fbox src_box;
 	int dst_width, dst_height;
 	enum wl_output_transform transform;
+	// The buffer's format has no alpha channel. Only valid if the buffer is
+	// in the scene's texture atlas, whose pages always have one.
+	bool atlas_opaque;
 };
 
 /** A viewport for an output in the scene-graph */
@@ -112,7 +151,19 @@ struct wlr_scene_output {
 
 	// private state
 
+	uint8_t index;
 	bool prev_scanout;
+
+	// Nodes intersecting the output viewport, in rendering order
+	struct wl_array render_list; // struct scene_render_entry
+	struct wlr_box render_list_box; // viewport the list was built for
+	bool render_list_dirty;
+
+	// Nodes displayed on output overlays by the last commit
+	struct wl_array overlays; // struct scene_overlay
+
+	// Surfaces visible on the output when it was last committed
+	struct wl_array visible_surfaces; // struct wlr_scene_surface *
 };
 
 typedef void (*wlr_scene_node_iterator_func_t)(struct wlr_scene_node *node,
@@ -182,6 +233,26 @@ struct wlr_scene_node *wlr_scene_node_at(struct wlr_scene_node *node,
  * Create a new scene-graph.
  */
 struct wlr_scene *wlr_scene_create(void);
+/**
+ * Set the minimum delay between two frame callbacks sent to surfaces which
+ * aren't visible on any output, see wlr_scene_output_send_frame_done(). The
+ * default is 1000 ms. Zero disables throttling.
+ */
+void wlr_scene_set_hidden_frame_interval(struct wlr_scene *scene,
+	int interval_ms);
+/**
+ * Set the texture atlas used for small buffer nodes. Buffers which fit in the
+ * atlas share a few large textures instead of getting a texture each, which
+ * allows the renderer to draw them without switching textures. The buffers'
+ * contents must not change after the nodes are created.
+ *
+ * The atlas is only used with the renderer it was created for. Buffers are
+ * added to it when their node is created, and when the atlas is set: neither
+ * may happen inside a rendering block. The compositor keeps ownership of the
+ * atlas, and must unset it before destroying it. NULL disables the atlas.
+ */
+void wlr_scene_set_texture_atlas(struct wlr_scene *scene,
+	struct wlr_texture_atlas *atlas);
 /**
  * Manually render the scene-graph on an output. The compositor needs to call
  * wlr_renderer_begin before and wlr_renderer_end after calling this function.
@@ -196,6 +267,18 @@ void wlr_scene_render_output(struct wlr_scene *scene, struct wlr_output *output,
  */
 struct wlr_scene_tree *wlr_scene_tree_create(struct wlr_scene_node *parent);
 
+/**
+ * Enable or disable caching of the tree's rendering. When enabled, the
+ * descendants of the tree are rendered into an offscreen buffer, which is
+ * then displayed as a single texture for as long as none of them change.
+ *
+ * This is useful for complex but mostly static sub-trees, e.g. panels made
+ * of many rects and buffers. Any change to a descendant re-renders the whole
+ * cache, so it should not be enabled for frequently updated sub-trees. Nodes
+ * in a cached tree are never directly scanned out.
+ */
+void wlr_scene_tree_set_cached(struct wlr_scene_tree *tree, bool cached);
+
 /**
  * Add a node displaying a single surface to the scene-graph.
  *
@@ -281,6 +364,20 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output);
  */
 void wlr_scene_output_for_each_surface(struct wlr_scene_output *scene_output,
 	wlr_surface_iterator_func_t iterator, void *user_data);
+/**
+ * Send frame done events to the surfaces which were visible on the output
+ * when it was last committed, i.e. which were neither off-screen nor fully
+ * covered by opaque nodes.
+ *
+ * Surfaces which aren't visible on any output get throttled frame done
+ * events instead, at most once per hidden frame interval (see
+ * wlr_scene_set_hidden_frame_interval()).
+ *
+ * This is meant to be called after wlr_scene_output_commit(), instead of
+ * sending frame done events via wlr_scene_output_for_each_surface().
+ */
+void wlr_scene_output_send_frame_done(struct wlr_scene_output *scene_output,
+	const struct timespec *now);
 
 /**
  * Attach an output layout to a scene.
@@ -148,6 +148,7 @@ struct wlr_surface {
 	// private state
 
 	struct wl_listener renderer_destroy;
+	struct wlr_allocator *allocator; // may be NULL
 
 	struct {
 		int32_t scale;
@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <wlr/util/log.h>
 #include <xf86drm.h>
@@ -11,6 +12,8 @@
 #include "render/allocator/drm_dumb.h"
 #include "render/allocator/gbm.h"
 #include "render/allocator/shm.h"
+#include "render/drm_format_set.h"
+#include "render/pixel_format.h"
 #include "render/wlr_renderer.h"
 
 void wlr_allocator_init(struct wlr_allocator *alloc,
@@ -19,6 +22,8 @@ void wlr_allocator_init(struct wlr_allocator *alloc,
 	alloc->impl = impl;
 	alloc->buffer_caps = buffer_caps;
 	wl_signal_init(&alloc->events.destroy);
+	wl_list_init(&alloc->cache);
+	wl_list_init(&alloc->buffers);
 }
 
 /* Re-open the DRM node to avoid GEM handle ref'counting issues. See:
@@ -84,9 +89,41 @@ static int reopen_drm_node(int drm_fd, bool allow_render_node) {
 	return new_fd;
 }
 
+static size_t parse_cache_size_env(const char *name) {
+	const char *size_str = getenv(name);
+	if (size_str == NULL) {
+		return 0;
+	}
+
+	char *end;
+	long size = strtol(size_str, &end, 10);
+	if (*end || size < 0) {
+		wlr_log(WLR_ERROR, "%s specified with invalid integer, ignoring", name);
+		return 0;
+	}
+
+	return (size_t)size * 1024 * 1024;
+}
+
+static struct wlr_allocator *allocator_autocreate_uncached(
+		struct wlr_backend *backend, struct wlr_renderer *renderer,
+		int drm_fd);
+
 struct wlr_allocator *allocator_autocreate_with_drm_fd(
 		struct wlr_backend *backend, struct wlr_renderer *renderer,
 		int drm_fd) {
+	struct wlr_allocator *alloc =
+		allocator_autocreate_uncached(backend, renderer, drm_fd);
+	if (alloc != NULL) {
+		wlr_allocator_set_cache_budget(alloc,
+			parse_cache_size_env("WLR_ALLOCATOR_CACHE_SIZE"));
+	}
+	return alloc;
+}
+
+static struct wlr_allocator *allocator_autocreate_uncached(
+		struct wlr_backend *backend, struct wlr_renderer *renderer,
+		int drm_fd) {
 	uint32_t backend_caps = backend_get_buffer_caps(backend);
 	uint32_t renderer_caps = renderer_get_render_buffer_caps(renderer);
 
@@ -141,18 +178,227 @@ struct wlr_allocator *wlr_allocator_autocreate(struct wlr_backend *backend,
 	return allocator_autocreate_with_drm_fd(backend, renderer, drm_fd);
 }
 
+struct wlr_allocator *allocator_autocreate_offscreen(
+		struct wlr_renderer *renderer) {
+	// Offscreen buffers are never handed to a backend, so only the renderer's
+	// capabilities matter. Only DMA-BUFs are worth rendering into: the other
+	// renderers draw on the CPU and can upload data directly.
+	uint32_t renderer_caps = renderer_get_render_buffer_caps(renderer);
+	int drm_fd = wlr_renderer_get_drm_fd(renderer);
+	if (!(renderer_caps & WLR_BUFFER_CAP_DMABUF) || drm_fd < 0) {
+		return NULL;
+	}
+
+	int gbm_fd = reopen_drm_node(drm_fd, true);
+	if (gbm_fd < 0) {
+		return NULL;
+	}
+	struct wlr_allocator *alloc = wlr_gbm_allocator_create(gbm_fd);
+	if (alloc == NULL) {
+		close(gbm_fd);
+		wlr_log(WLR_DEBUG, "Failed to create offscreen gbm allocator");
+		return NULL;
+	}
+	return alloc;
+}
+
+/**
+ * A buffer handed out by an allocator with a cache, wrapping the buffer
+ * created by the allocator implementation. When the wrapper is destroyed, the
+ * underlying buffer is moved to the cache instead of being destroyed.
+ *
+ * Users attach state to the wrapper (e.g. imported textures), so this state
+ * is re-created when the underlying buffer is re-used.
+ */
+struct wlr_allocator_buffer {
+	struct wlr_buffer base;
+	struct wlr_buffer *buffer;
+	struct wlr_allocator *allocator; // NULL if destroyed
+	struct wl_list link; // wlr_allocator.cache or wlr_allocator.buffers
+
+	int width, height;
+	struct wlr_drm_format *format;
+	size_t size; // estimated, in bytes
+};
+
+static const struct wlr_buffer_impl allocator_buffer_impl;
+
+static struct wlr_allocator_buffer *allocator_buffer_from_buffer(
+		struct wlr_buffer *wlr_buffer) {
+	assert(wlr_buffer->impl == &allocator_buffer_impl);
+	return (struct wlr_allocator_buffer *)wlr_buffer;
+}
+
+static void allocator_buffer_finish(struct wlr_allocator_buffer *buffer) {
+	wl_list_remove(&buffer->link);
+	wlr_buffer_drop(buffer->buffer);
+	free(buffer->format);
+	free(buffer);
+}
+
+static void allocator_trim_cache(struct wlr_allocator *alloc) {
+	while (alloc->cache_size > alloc->cache_budget) {
+		assert(!wl_list_empty(&alloc->cache));
+		struct wlr_allocator_buffer *buffer =
+			wl_container_of(alloc->cache.prev, buffer, link);
+		alloc->cache_size -= buffer->size;
+		allocator_buffer_finish(buffer);
+	}
+}
+
+static void allocator_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+	struct wlr_allocator_buffer *buffer =
+		allocator_buffer_from_buffer(wlr_buffer);
+	struct wlr_allocator *alloc = buffer->allocator;
+	if (alloc == NULL || buffer->size > alloc->cache_budget) {
+		allocator_buffer_finish(buffer);
+		return;
+	}
+
+	// The wrapper is re-initialized when taken out of the cache
+	memset(&buffer->base, 0, sizeof(buffer->base));
+
+	wl_list_remove(&buffer->link);
+	wl_list_insert(&alloc->cache, &buffer->link);
+	alloc->cache_size += buffer->size;
+	allocator_trim_cache(alloc);
+}
+
+static bool allocator_buffer_get_dmabuf(struct wlr_buffer *wlr_buffer,
+		struct wlr_dmabuf_attributes *attribs) {
+	struct wlr_allocator_buffer *buffer =
+		allocator_buffer_from_buffer(wlr_buffer);
+	return wlr_buffer_get_dmabuf(buffer->buffer, attribs);
+}
+
+static bool allocator_buffer_get_shm(struct wlr_buffer *wlr_buffer,
+		struct wlr_shm_attributes *attribs) {
+	struct wlr_allocator_buffer *buffer =
+		allocator_buffer_from_buffer(wlr_buffer);
+	return wlr_buffer_get_shm(buffer->buffer, attribs);
+}
+
+static bool allocator_buffer_begin_data_ptr_access(
+		struct wlr_buffer *wlr_buffer, uint32_t flags, void **data,
+		uint32_t *format, size_t *stride) {
+	struct wlr_allocator_buffer *buffer =
+		allocator_buffer_from_buffer(wlr_buffer);
+	return wlr_buffer_begin_data_ptr_access(buffer->buffer, flags,
+		data, format, stride);
+}
+
+static void allocator_buffer_end_data_ptr_access(
+		struct wlr_buffer *wlr_buffer) {
+	struct wlr_allocator_buffer *buffer =
+		allocator_buffer_from_buffer(wlr_buffer);
+	wlr_buffer_end_data_ptr_access(buffer->buffer);
+}
+
+static const struct wlr_buffer_impl allocator_buffer_impl = {
+	.destroy = allocator_buffer_destroy,
+	.get_dmabuf = allocator_buffer_get_dmabuf,
+	.get_shm = allocator_buffer_get_shm,
+	.begin_data_ptr_access = allocator_buffer_begin_data_ptr_access,
+	.end_data_ptr_access = allocator_buffer_end_data_ptr_access,
+};
+
+static bool drm_format_equal(const struct wlr_drm_format *a,
+		const struct wlr_drm_format *b) {
+	return a->format == b->format && a->len == b->len &&
+		memcmp(a->modifiers, b->modifiers, a->len * sizeof(a->modifiers[0])) == 0;
+}
+
+static struct wlr_allocator_buffer *allocator_take_cached_buffer(
+		struct wlr_allocator *alloc, int width, int height,
+		const struct wlr_drm_format *format) {
+	struct wlr_allocator_buffer *buffer;
+	wl_list_for_each(buffer, &alloc->cache, link) {
+		if (buffer->width == width && buffer->height == height &&
+				drm_format_equal(buffer->format, format)) {
+			alloc->cache_size -= buffer->size;
+			return buffer;
+		}
+	}
+	return NULL;
+}
+
+static struct wlr_buffer *allocator_create_cached_buffer(
+		struct wlr_allocator *alloc, int width, int height,
+		const struct wlr_drm_format *format) {
+	struct wlr_allocator_buffer *buffer =
+		allocator_take_cached_buffer(alloc, width, height, format);
+	if (buffer == NULL) {
+		buffer = calloc(1, sizeof(*buffer));
+		if (buffer == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return NULL;
+		}
+		buffer->format = wlr_drm_format_dup(format);
+		if (buffer->format == NULL) {
+			free(buffer);
+			return NULL;
+		}
+		buffer->buffer =
+			alloc->impl->create_buffer(alloc, width, height, format);
+		if (buffer->buffer == NULL) {
+			free(buffer->format);
+			free(buffer);
+			return NULL;
+		}
+		const struct wlr_pixel_format_info *info =
+			drm_get_pixel_format_info(format->format);
+		int bpp = info != NULL ? info->bpp : 32;
+		buffer->width = width;
+		buffer->height = height;
+		buffer->size = (size_t)width * height * bpp / 8;
+		buffer->allocator = alloc;
+		wl_list_init(&buffer->link);
+	}
+
+	wlr_buffer_init(&buffer->base, &allocator_buffer_impl, width, height);
+	wl_list_remove(&buffer->link);
+	wl_list_insert(&alloc->buffers, &buffer->link);
+	return &buffer->base;
+}
+
+void wlr_allocator_set_cache_budget(struct wlr_allocator *alloc,
+		size_t budget) {
+	if (budget > 0 && alloc->cache_budget == 0) {
+		wlr_log(WLR_DEBUG, "Caching up to %zu bytes of allocator buffers",
+			budget);
+	}
+	alloc->cache_budget = budget;
+	allocator_trim_cache(alloc);
+}
+
 void wlr_allocator_destroy(struct wlr_allocator *alloc) {
 	if (alloc == NULL) {
 		return;
 	}
 	wl_signal_emit(&alloc->events.destroy, NULL);
+
+	alloc->cache_budget = 0;
+	allocator_trim_cache(alloc);
+
+	// Buffers still in use destroy their underlying buffer themselves
+	struct wlr_allocator_buffer *buffer, *buffer_tmp;
+	wl_list_for_each_safe(buffer, buffer_tmp, &alloc->buffers, link) {
+		buffer->allocator = NULL;
+		wl_list_remove(&buffer->link);
+		wl_list_init(&buffer->link);
+	}
+
 	alloc->impl->destroy(alloc);
 }
 
 struct wlr_buffer *wlr_allocator_create_buffer(struct wlr_allocator *alloc,
 		int width, int height, const struct wlr_drm_format *format) {
-	struct wlr_buffer *buffer =
-		alloc->impl->create_buffer(alloc, width, height, format);
+	struct wlr_buffer *buffer;
+	if (alloc->cache_budget > 0) {
+		buffer = allocator_create_cached_buffer(alloc, width, height, format);
+	} else {
+		buffer = alloc->impl->create_buffer(alloc, width, height, format);
+	}
 	if (buffer == NULL) {
 		return NULL;
 	}
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <drm_fourcc.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <wlr/util/log.h>
@@ -8,7 +9,15 @@
 #include "render/allocator/shm.h"
 #include "util/shm.h"
 
+// Buffers are carved out of pools of at least this size. Larger buffers get a
+// pool of their own.
+#define POOL_SIZE (16 * 1024 * 1024)
+// Buffers start on their own page, so that pages are never shared between
+// two buffers
+#define BUFFER_ALIGN 4096
+
 static const struct wlr_buffer_impl buffer_impl;
+static const struct wlr_allocator_interface allocator_impl;
 
 static struct wlr_shm_buffer *shm_buffer_from_buffer(
 		struct wlr_buffer *wlr_buffer) {
@@ -16,10 +25,159 @@ static struct wlr_shm_buffer *shm_buffer_from_buffer(
 	return (struct wlr_shm_buffer *)wlr_buffer;
 }
 
+static struct wlr_shm_allocator *shm_allocator_from_allocator(
+		struct wlr_allocator *wlr_allocator) {
+	assert(wlr_allocator->impl == &allocator_impl);
+	return (struct wlr_shm_allocator *)wlr_allocator;
+}
+
+static struct wlr_shm_allocator_pool *pool_create(
+		struct wlr_shm_allocator *allocator, size_t size) {
+	struct wlr_shm_allocator_pool *pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	pool->fd = allocate_shm_file(size);
+	if (pool->fd < 0) {
+		free(pool);
+		return NULL;
+	}
+
+	pool->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		pool->fd, 0);
+	if (pool->data == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		close(pool->fd);
+		free(pool);
+		return NULL;
+	}
+
+	wl_array_init(&pool->free_ranges);
+	struct wlr_shm_range *range =
+		wl_array_add(&pool->free_ranges, sizeof(*range));
+	if (range == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		munmap(pool->data, size);
+		close(pool->fd);
+		free(pool);
+		return NULL;
+	}
+	*range = (struct wlr_shm_range){ .offset = 0, .size = size };
+
+	pool->size = size;
+	pool->allocator = allocator;
+	wl_list_insert(&allocator->pools, &pool->link);
+	return pool;
+}
+
+static void pool_destroy(struct wlr_shm_allocator_pool *pool) {
+	assert(pool->buffers_len == 0);
+	wl_list_remove(&pool->link);
+	wl_array_release(&pool->free_ranges);
+	munmap(pool->data, pool->size);
+	close(pool->fd);
+	free(pool);
+}
+
+/**
+ * Carve a range out of the pool's free list, first fit. Returns false if
+ * there's no large enough free range.
+ */
+static bool pool_alloc(struct wlr_shm_allocator_pool *pool, size_t size,
+		size_t *offset) {
+	struct wlr_shm_range *range;
+	wl_array_for_each(range, &pool->free_ranges) {
+		if (range->size < size) {
+			continue;
+		}
+
+		*offset = range->offset;
+		range->offset += size;
+		range->size -= size;
+		if (range->size == 0) {
+			struct wlr_shm_range *end =
+				(void *)((char *)pool->free_ranges.data + pool->free_ranges.size);
+			memmove(range, range + 1, (char *)end - (char *)(range + 1));
+			pool->free_ranges.size -= sizeof(*range);
+		}
+
+		// Buffers are expected to start out cleared, like fresh shm files
+		if (*offset < pool->dirty_end) {
+			size_t dirty_size = pool->dirty_end - *offset;
+			memset((char *)pool->data + *offset, 0,
+				dirty_size < size ? dirty_size : size);
+		}
+		if (*offset + size > pool->dirty_end) {
+			pool->dirty_end = *offset + size;
+		}
+
+		pool->buffers_len++;
+		return true;
+	}
+	return false;
+}
+
+static void pool_free(struct wlr_shm_allocator_pool *pool, size_t offset,
+		size_t size) {
+	struct wlr_shm_range *ranges = pool->free_ranges.data;
+	size_t ranges_len = pool->free_ranges.size / sizeof(ranges[0]);
+
+	size_t i = 0;
+	while (i < ranges_len && ranges[i].offset < offset) {
+		i++;
+	}
+
+	// Merge with the neighbouring free ranges if possible
+	bool merge_prev = i > 0 &&
+		ranges[i - 1].offset + ranges[i - 1].size == offset;
+	bool merge_next = i < ranges_len && offset + size == ranges[i].offset;
+	if (merge_prev && merge_next) {
+		ranges[i - 1].size += size + ranges[i].size;
+		memmove(&ranges[i], &ranges[i + 1],
+			(ranges_len - i - 1) * sizeof(ranges[0]));
+		pool->free_ranges.size -= sizeof(ranges[0]);
+	} else if (merge_prev) {
+		ranges[i - 1].size += size;
+	} else if (merge_next) {
+		ranges[i].offset = offset;
+		ranges[i].size += size;
+	} else if (wl_array_add(&pool->free_ranges, sizeof(ranges[0])) != NULL) {
+		ranges = pool->free_ranges.data;
+		memmove(&ranges[i + 1], &ranges[i],
+			(ranges_len - i) * sizeof(ranges[0]));
+		ranges[i] = (struct wlr_shm_range){ .offset = offset, .size = size };
+	} else {
+		// The range is leaked until the pool is destroyed
+		wlr_log(WLR_ERROR, "Allocation failed");
+	}
+
+	assert(pool->buffers_len > 0);
+	pool->buffers_len--;
+	if (pool->buffers_len > 0) {
+		return;
+	}
+
+	if (pool->allocator == NULL) {
+		pool_destroy(pool);
+		return;
+	}
+
+	// Keep a single empty pool around, so that re-allocating buffers (e.g.
+	// when an output is resized) doesn't need a new file and mapping
+	struct wlr_shm_allocator_pool *other;
+	wl_list_for_each(other, &pool->allocator->pools, link) {
+		if (other != pool && other->buffers_len == 0) {
+			pool_destroy(other->size < pool->size ? other : pool);
+			return;
+		}
+	}
+}
+
 static void buffer_destroy(struct wlr_buffer *wlr_buffer) {
 	struct wlr_shm_buffer *buffer = shm_buffer_from_buffer(wlr_buffer);
-	munmap(buffer->data, buffer->size);
-	close(buffer->shm.fd);
+	pool_free(buffer->pool, buffer->shm.offset, buffer->size);
 	free(buffer);
 }
 
@@ -60,42 +218,72 @@ static struct wlr_buffer *allocator_create_buffer(
 		return NULL;
 	}
 
+	struct wlr_shm_allocator *allocator =
+		shm_allocator_from_allocator(wlr_allocator);
+
+	// Strides aren't padded: MIT-SHM pixmaps (used by the X11 backend) don't
+	// have an explicit stride, the X server assumes tightly packed rows
+	int bytes_per_pixel = info->bpp / 8;
+	int stride = width * bytes_per_pixel;
+	size_t size = (size_t)stride * height;
+	size_t aligned_size = (size + BUFFER_ALIGN - 1) & ~(size_t)(BUFFER_ALIGN - 1);
+
 	struct wlr_shm_buffer *buffer = calloc(1, sizeof(*buffer));
 	if (buffer == NULL) {
 		return NULL;
 	}
-	wlr_buffer_init(&buffer->base, &buffer_impl, width, height);
 
-	// TODO: consider using a single file for multiple buffers
-	int bytes_per_pixel = info->bpp / 8;
-	int stride = width * bytes_per_pixel; // TODO: align?
-	buffer->size = stride * height;
-	buffer->shm.fd = allocate_shm_file(buffer->size);
-	if (buffer->shm.fd < 0) {
+	size_t offset = 0;
+	struct wlr_shm_allocator_pool *pool;
+	wl_list_for_each(pool, &allocator->pools, link) {
+		if (pool_alloc(pool, aligned_size, &offset)) {
+			goto found;
+		}
+	}
+
+	pool = pool_create(allocator,
+		aligned_size > POOL_SIZE ? aligned_size : POOL_SIZE);
+	if (pool == NULL || !pool_alloc(pool, aligned_size, &offset)) {
+		if (pool != NULL) {
+			pool_destroy(pool);
+		}
 		free(buffer);
 		return NULL;
 	}
 
+found:
+	wlr_buffer_init(&buffer->base, &buffer_impl, width, height);
+	buffer->pool = pool;
+	buffer->data = (char *)pool->data + offset;
+	buffer->size = aligned_size;
+
+	buffer->shm.fd = pool->fd;
 	buffer->shm.format = format->format;
 	buffer->shm.width = width;
 	buffer->shm.height = height;
 	buffer->shm.stride = stride;
-	buffer->shm.offset = 0;
-
-	buffer->data = mmap(NULL, buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED,
-		buffer->shm.fd, 0);
-	if (buffer->data == MAP_FAILED) {
-		wlr_log_errno(WLR_ERROR, "mmap failed");
-		close(buffer->shm.fd);
-		free(buffer);
-		return NULL;
-	}
+	buffer->shm.offset = offset;
 
 	return &buffer->base;
 }
 
 static void allocator_destroy(struct wlr_allocator *wlr_allocator) {
-	free(wlr_allocator);
+	struct wlr_shm_allocator *allocator =
+		shm_allocator_from_allocator(wlr_allocator);
+
+	// Pools still in use are destroyed along with their last buffer
+	struct wlr_shm_allocator_pool *pool, *pool_tmp;
+	wl_list_for_each_safe(pool, pool_tmp, &allocator->pools, link) {
+		if (pool->buffers_len == 0) {
+			pool_destroy(pool);
+			continue;
+		}
+		pool->allocator = NULL;
+		wl_list_remove(&pool->link);
+		wl_list_init(&pool->link);
+	}
+
+	free(allocator);
 }
 
 static const struct wlr_allocator_interface allocator_impl = {
@@ -110,6 +298,7 @@ struct wlr_allocator *wlr_shm_allocator_create(void) {
 	}
 	wlr_allocator_init(&allocator->base, &allocator_impl,
 		WLR_BUFFER_CAP_DATA_PTR | WLR_BUFFER_CAP_SHM);
+	wl_list_init(&allocator->pools);
 
 	wlr_log(WLR_DEBUG, "Created shm allocator");
 	return &allocator->base;
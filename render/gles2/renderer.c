@@ -3,9 +3,11 @@
 #include <gbm.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <wayland-server-protocol.h>
 #include <wayland-util.h>
@@ -18,6 +20,7 @@
 #include "render/egl.h"
 #include "render/gles2.h"
 #include "render/pixel_format.h"
+#include "render/wlr_renderer.h"
 
 static const GLfloat verts[] = {
 	1, 0, // top right
@@ -192,6 +195,74 @@ static bool gles2_bind_buffer(struct wlr_renderer *wlr_renderer,
 	return true;
 }
 
+void gles2_bind_texture(struct wlr_gles2_renderer *renderer, GLenum target,
+		GLuint tex) {
+	if (renderer->state.tex_target == target && renderer->state.tex == tex) {
+		return;
+	}
+	if (tex == 0 && renderer->state.tex_target != target) {
+		// Another target is bound, nothing to unbind
+		glBindTexture(target, 0);
+		return;
+	}
+	glBindTexture(target, tex);
+	renderer->state.tex_target = target;
+	renderer->state.tex = tex;
+}
+
+static void use_program(struct wlr_gles2_renderer *renderer, GLuint program) {
+	if (renderer->state.program != program) {
+		glUseProgram(program);
+		renderer->state.program = program;
+	}
+}
+
+static void set_blend(struct wlr_gles2_renderer *renderer, bool blend) {
+	if (renderer->state.blend == blend) {
+		return;
+	}
+	if (blend) {
+		glEnable(GL_BLEND);
+	} else {
+		glDisable(GL_BLEND);
+	}
+	renderer->state.blend = blend;
+}
+
+/**
+ * Set up the GL state used for drawing from scratch, and reset the cache of
+ * that state. Compositors may issue their own GL calls between wlr_render_*
+ * calls, so this is done by each drawing entry point. Uniforms are program
+ * state and are left alone.
+ */
+static void reset_gl_state(struct wlr_gles2_renderer *renderer) {
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	glUseProgram(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDisable(GL_BLEND);
+	renderer->state.program = 0;
+	renderer->state.tex_target = GL_TEXTURE_2D;
+	renderer->state.tex = 0;
+	renderer->state.blend = false;
+
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+	glVertexAttribPointer(WLR_GLES2_ATTRIB_POS, 2, GL_FLOAT, GL_FALSE,
+		sizeof(struct wlr_gles2_vertex),
+		(void *)offsetof(struct wlr_gles2_vertex, x));
+	glVertexAttribPointer(WLR_GLES2_ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE,
+		sizeof(struct wlr_gles2_vertex),
+		(void *)offsetof(struct wlr_gles2_vertex, u));
+	glVertexAttribPointer(WLR_GLES2_ATTRIB_TEXCLAMP, 4, GL_FLOAT, GL_FALSE,
+		sizeof(struct wlr_gles2_vertex),
+		(void *)offsetof(struct wlr_gles2_vertex, u_min));
+	glEnableVertexAttribArray(WLR_GLES2_ATTRIB_POS);
+	glEnableVertexAttribArray(WLR_GLES2_ATTRIB_TEXCOORD);
+	glEnableVertexAttribArray(WLR_GLES2_ATTRIB_TEXCLAMP);
+}
+
 static void gles2_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 		uint32_t height) {
 	struct wlr_gles2_renderer *renderer =
@@ -207,7 +278,7 @@ static void gles2_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 	wlr_matrix_projection(renderer->projection, width, height,
 			WL_OUTPUT_TRANSFORM_NORMAL);
 
-	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	reset_gl_state(renderer);
 
 	// XXX: maybe we should save output projection and remove some of the need
 	// for users to sling matricies themselves
@@ -216,8 +287,99 @@ static void gles2_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 }
 
 static void gles2_end(struct wlr_renderer *wlr_renderer) {
-	gles2_get_renderer_in_context(wlr_renderer);
-	// no-op
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	push_gles2_debug(renderer);
+
+	// Leave the GL state clean for the compositor
+	glDisableVertexAttribArray(WLR_GLES2_ATTRIB_POS);
+	glDisableVertexAttribArray(WLR_GLES2_ATTRIB_TEXCOORD);
+	glDisableVertexAttribArray(WLR_GLES2_ATTRIB_TEXCLAMP);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindTexture(renderer->state.tex_target, 0);
+	glUseProgram(0);
+
+	pop_gles2_debug(renderer);
+}
+
+/**
+ * Emit the results of the timer queries which are available, oldest first.
+ */
+static void collect_timer_queries(struct wlr_gles2_renderer *renderer) {
+	// Timestamps are meaningless if the GPU was reset, its frequency changed,
+	// etc. in the meantime
+	GLint disjoint = 0;
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+	for (size_t i = 0; i < WLR_GLES2_TIMER_QUERIES; i++) {
+		size_t index =
+			(renderer->timer_query_next + i) % WLR_GLES2_TIMER_QUERIES;
+		struct wlr_gles2_timer_query *query = &renderer->timer_queries[index];
+		if (!query->pending) {
+			continue;
+		}
+
+		if (!disjoint) {
+			GLint available = 0;
+			renderer->procs.glGetQueryObjectivEXT(query->end,
+				GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+			if (!available) {
+				// Later queries can't be available either
+				break;
+			}
+		}
+		query->pending = false;
+		if (disjoint) {
+			continue;
+		}
+
+		GLuint64 begin_ns = 0, end_ns = 0;
+		renderer->procs.glGetQueryObjectui64vEXT(query->begin,
+			GL_QUERY_RESULT_EXT, &begin_ns);
+		renderer->procs.glGetQueryObjectui64vEXT(query->end,
+			GL_QUERY_RESULT_EXT, &end_ns);
+		wlr_renderer_emit_timing(&renderer->wlr_renderer, query->render_seq,
+			begin_ns, end_ns);
+	}
+}
+
+static bool gles2_begin_timing(struct wlr_renderer *wlr_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+	if (!renderer->exts.EXT_disjoint_timer_query) {
+		return false;
+	}
+
+	push_gles2_debug(renderer);
+
+	collect_timer_queries(renderer);
+
+	// If the results of the oldest query still aren't available, drop it
+	struct wlr_gles2_timer_query *query =
+		&renderer->timer_queries[renderer->timer_query_next];
+	query->pending = false;
+	query->render_seq = wlr_renderer->render_seq;
+	renderer->procs.glQueryCounterEXT(query->begin, GL_TIMESTAMP_EXT);
+
+	pop_gles2_debug(renderer);
+	return true;
+}
+
+static void gles2_end_timing(struct wlr_renderer *wlr_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	push_gles2_debug(renderer);
+
+	struct wlr_gles2_timer_query *query =
+		&renderer->timer_queries[renderer->timer_query_next];
+	renderer->procs.glQueryCounterEXT(query->end, GL_TIMESTAMP_EXT);
+	query->pending = true;
+	renderer->timer_query_next =
+		(renderer->timer_query_next + 1) % WLR_GLES2_TIMER_QUERIES;
+
+	pop_gles2_debug(renderer);
 }
 
 static void gles2_clear(struct wlr_renderer *wlr_renderer,
@@ -252,12 +414,83 @@ static const float flip_180[9] = {
 	0.0f, 0.0f, 1.0f,
 };
 
-static bool gles2_render_subtexture_with_matrix(
-		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
-		const struct wlr_fbox *box, const float matrix[static 9],
+/**
+ * Append the vertices of a quad to the pending vertex data. If box is not
+ * NULL, it's the source box of the texture.
+ */
+static bool push_quad_vertices(struct wlr_gles2_renderer *renderer,
+		const float matrix[static 9], struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *box) {
+	struct wlr_gles2_vertex *vertices = wl_array_add(&renderer->vertices,
+		4 * sizeof(*vertices));
+	if (vertices == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+
+	float gl_matrix[9];
+	wlr_matrix_multiply(gl_matrix, renderer->projection, matrix);
+	wlr_matrix_multiply(gl_matrix, flip_180, gl_matrix);
+
+	GLfloat x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+	GLfloat clamp_x1 = 0, clamp_y1 = 0, clamp_x2 = 0, clamp_y2 = 0;
+	bool inverted_y = false;
+	if (wlr_texture != NULL) {
+		double width = wlr_texture->width, height = wlr_texture->height;
+		x1 = box->x / width;
+		y1 = box->y / height;
+		x2 = (box->x + box->width) / width;
+		y2 = (box->y + box->height) / height;
+		inverted_y = gles2_get_texture(wlr_texture)->inverted_y;
+
+		// Texel centers closest to the edges of the box. Boxes smaller than a
+		// texel sample their center.
+		double half_x = box->width < 1 ? box->width / 2 : 0.5;
+		double half_y = box->height < 1 ? box->height / 2 : 0.5;
+		clamp_x1 = (box->x + half_x) / width;
+		clamp_x2 = (box->x + box->width - half_x) / width;
+		clamp_y1 = (box->y + half_y) / height;
+		clamp_y2 = (box->y + box->height - half_y) / height;
+		if (inverted_y) {
+			GLfloat tmp = clamp_y1;
+			clamp_y1 = 1.0 - clamp_y2;
+			clamp_y2 = 1.0 - tmp;
+		}
+	}
+
+	for (size_t i = 0; i < 4; i++) {
+		GLfloat x = verts[2 * i], y = verts[2 * i + 1];
+		GLfloat v = y == 0 ? y1 : y2;
+		vertices[i] = (struct wlr_gles2_vertex){
+			.x = gl_matrix[0] * x + gl_matrix[1] * y + gl_matrix[2],
+			.y = gl_matrix[3] * x + gl_matrix[4] * y + gl_matrix[5],
+			.u = x == 0 ? x1 : x2,
+			.v = inverted_y ? 1.0 - v : v,
+			.u_min = clamp_x1,
+			.v_min = clamp_y1,
+			.u_max = clamp_x2,
+			.v_max = clamp_y2,
+		};
+	}
+	return true;
+}
+
+/**
+ * Upload the pending vertex data to the streaming vertex buffer. The buffer
+ * storage is orphaned so that in-flight draws don't stall the upload.
+ */
+static void upload_vertices(struct wlr_gles2_renderer *renderer) {
+	glBufferData(GL_ARRAY_BUFFER, renderer->vertices.size,
+		renderer->vertices.data, GL_STREAM_DRAW);
+	renderer->vertices.size = 0;
+}
+
+/**
+ * Set up the GL state to draw a textured quad. Returns NULL on error.
+ */
+static struct wlr_gles2_tex_shader *setup_texture_draw(
+		struct wlr_gles2_renderer *renderer, struct wlr_texture *wlr_texture,
 		float alpha) {
-	struct wlr_gles2_renderer *renderer =
-		gles2_get_renderer_in_context(wlr_renderer);
 	struct wlr_gles2_texture *texture =
 		gles2_get_texture(wlr_texture);
 	assert(texture->renderer == renderer);
@@ -278,65 +511,62 @@ static bool gles2_render_subtexture_with_matrix(
 		if (!renderer->exts.OES_egl_image_external) {
 			wlr_log(WLR_ERROR, "Failed to render texture: "
 				"GL_TEXTURE_EXTERNAL_OES not supported");
-			return false;
+			return NULL;
 		}
 		break;
 	default:
 		abort();
 	}
 
-	float gl_matrix[9];
-	wlr_matrix_multiply(gl_matrix, renderer->projection, matrix);
-	wlr_matrix_multiply(gl_matrix, flip_180, gl_matrix);
+	set_blend(renderer, texture->has_alpha || alpha != 1.0);
+	gles2_bind_texture(renderer, texture->target, texture->tex);
+	use_program(renderer, shader->program);
 
-	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
-	// to GL_FALSE
-	wlr_matrix_transpose(gl_matrix, gl_matrix);
-
-	push_gles2_debug(renderer);
-
-	if (!texture->has_alpha && alpha == 1.0) {
-		glDisable(GL_BLEND);
-	} else {
-		glEnable(GL_BLEND);
+	if (shader->alpha_value != alpha) {
+		glUniform1f(shader->alpha, alpha);
+		shader->alpha_value = alpha;
 	}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(texture->target, texture->tex);
-
-	glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	glUseProgram(shader->program);
+	return shader;
+}
 
-	glUniformMatrix3fv(shader->proj, 1, GL_FALSE, gl_matrix);
-	glUniform1i(shader->invert_y, texture->inverted_y);
-	glUniform1i(shader->tex, 0);
-	glUniform1f(shader->alpha, alpha);
+static void setup_quad_draw(struct wlr_gles2_renderer *renderer,
+		const float color[static 4]) {
+	set_blend(renderer, color[3] != 1.0);
+	use_program(renderer, renderer->shaders.quad.program);
+
+	GLfloat *value = renderer->shaders.quad.color_value;
+	if (memcmp(value, color, sizeof(renderer->shaders.quad.color_value)) != 0) {
+		glUniform4f(renderer->shaders.quad.color,
+			color[0], color[1], color[2], color[3]);
+		memcpy(value, color, sizeof(renderer->shaders.quad.color_value));
+	}
+}
 
-	const GLfloat x1 = box->x / wlr_texture->width;
-	const GLfloat y1 = box->y / wlr_texture->height;
-	const GLfloat x2 = (box->x + box->width) / wlr_texture->width;
-	const GLfloat y2 = (box->y + box->height) / wlr_texture->height;
-	const GLfloat texcoord[] = {
-		x2, y1, // top right
-		x1, y1, // top left
-		x2, y2, // bottom right
-		x1, y2, // bottom left
-	};
+static bool gles2_render_subtexture_with_matrix(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *box, const float matrix[static 9],
+		float alpha) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
 
-	glVertexAttribPointer(shader->pos_attrib, 2, GL_FLOAT, GL_FALSE, 0, verts);
-	glVertexAttribPointer(shader->tex_attrib, 2, GL_FLOAT, GL_FALSE, 0, texcoord);
+	push_gles2_debug(renderer);
+	reset_gl_state(renderer);
 
-	glEnableVertexAttribArray(shader->pos_attrib);
-	glEnableVertexAttribArray(shader->tex_attrib);
+	struct wlr_gles2_tex_shader *shader =
+		setup_texture_draw(renderer, wlr_texture, alpha);
+	if (shader == NULL) {
+		pop_gles2_debug(renderer);
+		return false;
+	}
 
+	if (!push_quad_vertices(renderer, matrix, wlr_texture, box)) {
+		pop_gles2_debug(renderer);
+		return false;
+	}
+	upload_vertices(renderer);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-	glDisableVertexAttribArray(shader->pos_attrib);
-	glDisableVertexAttribArray(shader->tex_attrib);
-
-	glBindTexture(texture->target, 0);
-
 	pop_gles2_debug(renderer);
 	return true;
 }
@@ -346,37 +576,91 @@ static void gles2_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 	struct wlr_gles2_renderer *renderer =
 		gles2_get_renderer_in_context(wlr_renderer);
 
-	float gl_matrix[9];
-	wlr_matrix_multiply(gl_matrix, renderer->projection, matrix);
-	wlr_matrix_multiply(gl_matrix, flip_180, gl_matrix);
-
-	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
-	// to GL_FALSE
-	wlr_matrix_transpose(gl_matrix, gl_matrix);
-
 	push_gles2_debug(renderer);
+	reset_gl_state(renderer);
 
-	if (color[3] == 1.0) {
-		glDisable(GL_BLEND);
-	} else {
-		glEnable(GL_BLEND);
+	setup_quad_draw(renderer, color);
+	if (push_quad_vertices(renderer, matrix, NULL, NULL)) {
+		upload_vertices(renderer);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 	}
 
-	glUseProgram(renderer->shaders.quad.program);
+	pop_gles2_debug(renderer);
+}
 
-	glUniformMatrix3fv(renderer->shaders.quad.proj, 1, GL_FALSE, gl_matrix);
-	glUniform4f(renderer->shaders.quad.color, color[0], color[1], color[2], color[3]);
+static void draw_clipped(const struct wlr_render_quad *quads, size_t quads_len,
+		GLint first) {
+	for (size_t i = 0; i < quads_len; i++) {
+		const struct wlr_box *clip = &quads[i].clip;
+		if (wlr_box_empty(clip)) {
+			continue;
+		}
+		glScissor(clip->x, clip->y, clip->width, clip->height);
+		glDrawArrays(GL_TRIANGLE_STRIP, first, 4);
+	}
+}
 
-	glVertexAttribPointer(renderer->shaders.quad.pos_attrib, 2, GL_FLOAT, GL_FALSE,
-			0, verts);
+static size_t get_run_len(const struct wlr_render_quad *quads,
+		size_t quads_len) {
+	size_t run_len = 1;
+	while (run_len < quads_len &&
+			render_quads_share_state(&quads[0], &quads[run_len])) {
+		run_len++;
+	}
+	return run_len;
+}
 
-	glEnableVertexAttribArray(renderer->shaders.quad.pos_attrib);
+static bool gles2_render_quads(struct wlr_renderer *wlr_renderer,
+		const struct wlr_render_quad *quads, size_t quads_len) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	push_gles2_debug(renderer);
+	reset_gl_state(renderer);
+
+	// Quads sharing their state only differ by their scissor box: they share
+	// their vertices. Upload the vertices of all runs at once.
+	size_t i = 0;
+	while (i < quads_len) {
+		const struct wlr_render_quad *quad = &quads[i];
+		if (!push_quad_vertices(renderer, quad->matrix, quad->texture,
+				&quad->src_box)) {
+			renderer->vertices.size = 0;
+			pop_gles2_debug(renderer);
+			return false;
+		}
+		i += get_run_len(quad, quads_len - i);
+	}
+	upload_vertices(renderer);
+
+	glEnable(GL_SCISSOR_TEST);
+
+	bool ok = true;
+	GLint first = 0;
+	i = 0;
+	while (i < quads_len) {
+		const struct wlr_render_quad *quad = &quads[i];
+		size_t run_len = get_run_len(quad, quads_len - i);
+
+		if (quad->texture != NULL) {
+			if (setup_texture_draw(renderer, quad->texture,
+					quad->alpha) != NULL) {
+				draw_clipped(quad, run_len, first);
+			} else {
+				ok = false;
+			}
+		} else {
+			setup_quad_draw(renderer, quad->color);
+			draw_clipped(quad, run_len, first);
+		}
 
-	glDisableVertexAttribArray(renderer->shaders.quad.pos_attrib);
+		first += 4;
+		i += run_len;
+	}
 
+	glDisable(GL_SCISSOR_TEST);
 	pop_gles2_debug(renderer);
+	return ok;
 }
 
 static const uint32_t *gles2_get_shm_texture_formats(
@@ -490,6 +774,30 @@ static int gles2_get_drm_fd(struct wlr_renderer *wlr_renderer) {
 	return renderer->drm_fd;
 }
 
+static int gles2_export_sync_file(struct wlr_renderer *wlr_renderer) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+	if (!renderer->egl->exts.ANDROID_native_fence_sync) {
+		return -1;
+	}
+
+	struct wlr_egl_context prev_ctx;
+	wlr_egl_save_context(&prev_ctx);
+	wlr_egl_make_current(renderer->egl);
+
+	int fd = -1;
+	EGLSyncKHR sync = wlr_egl_create_fence_sync(renderer->egl);
+	if (sync != EGL_NO_SYNC_KHR) {
+		// The sync_file is only created once the fence has been submitted
+		glFlush();
+		fd = wlr_egl_dup_fence_fd(renderer->egl, sync);
+		wlr_egl_destroy_sync(renderer->egl, sync);
+	}
+
+	wlr_egl_restore_context(&prev_ctx);
+
+	return fd;
+}
+
 static uint32_t gles2_get_render_buffer_caps(struct wlr_renderer *wlr_renderer) {
 	return WLR_BUFFER_CAP_DMABUF;
 }
@@ -520,8 +828,25 @@ static void gles2_destroy(struct wlr_renderer *wlr_renderer) {
 	glDeleteProgram(renderer->shaders.tex_rgba.program);
 	glDeleteProgram(renderer->shaders.tex_rgbx.program);
 	glDeleteProgram(renderer->shaders.tex_ext.program);
+	glDeleteBuffers(1, &renderer->vbo);
+	if (renderer->exts.EXT_disjoint_timer_query) {
+		for (size_t i = 0; i < WLR_GLES2_TIMER_QUERIES; i++) {
+			struct wlr_gles2_timer_query *query = &renderer->timer_queries[i];
+			renderer->procs.glDeleteQueriesEXT(1, &query->begin);
+			renderer->procs.glDeleteQueriesEXT(1, &query->end);
+		}
+	}
+	for (size_t i = 0; i < WLR_GLES2_STAGING_BUFFERS; i++) {
+		struct wlr_gles2_staging_buffer *staging = &renderer->staging[i];
+		if (staging->fence != NULL) {
+			renderer->procs.glDeleteSyncAPPLE(staging->fence);
+		}
+		glDeleteBuffers(1, &staging->pbo);
+	}
 	pop_gles2_debug(renderer);
 
+	wl_array_release(&renderer->vertices);
+
 	if (renderer->exts.KHR_debug) {
 		glDisable(GL_DEBUG_OUTPUT_KHR);
 		renderer->procs.glDebugMessageCallbackKHR(NULL, NULL);
@@ -546,14 +871,18 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.scissor = gles2_scissor,
 	.render_subtexture_with_matrix = gles2_render_subtexture_with_matrix,
 	.render_quad_with_matrix = gles2_render_quad_with_matrix,
+	.render_quads = gles2_render_quads,
 	.get_shm_texture_formats = gles2_get_shm_texture_formats,
 	.get_dmabuf_texture_formats = gles2_get_dmabuf_texture_formats,
 	.get_render_formats = gles2_get_render_formats,
 	.preferred_read_format = gles2_preferred_read_format,
 	.read_pixels = gles2_read_pixels,
 	.get_drm_fd = gles2_get_drm_fd,
+	.export_sync_file = gles2_export_sync_file,
 	.get_render_buffer_caps = gles2_get_render_buffer_caps,
 	.texture_from_buffer = gles2_texture_from_buffer,
+	.begin_timing = gles2_begin_timing,
+	.end_timing = gles2_end_timing,
 };
 
 void push_gles2_debug_(struct wlr_gles2_renderer *renderer,
@@ -631,6 +960,9 @@ static GLuint link_program(struct wlr_gles2_renderer *renderer,
 	GLuint prog = glCreateProgram();
 	glAttachShader(prog, vert);
 	glAttachShader(prog, frag);
+	glBindAttribLocation(prog, WLR_GLES2_ATTRIB_POS, "pos");
+	glBindAttribLocation(prog, WLR_GLES2_ATTRIB_TEXCOORD, "texcoord");
+	glBindAttribLocation(prog, WLR_GLES2_ATTRIB_TEXCLAMP, "texclamp");
 	glLinkProgram(prog);
 
 	glDetachShader(prog, vert);
@@ -680,6 +1012,22 @@ static void load_gl_proc(void *proc_ptr, const char *name) {
 	*(void **)proc_ptr = proc;
 }
 
+/**
+ * Look up the uniforms of a textured quad program, and set their initial
+ * values. Uniforms which never change are only set here.
+ */
+static void init_tex_shader(struct wlr_gles2_tex_shader *shader,
+		GLuint prog) {
+	shader->program = prog;
+	shader->tex = glGetUniformLocation(prog, "tex");
+	shader->alpha = glGetUniformLocation(prog, "alpha");
+
+	glUseProgram(prog);
+	glUniform1i(shader->tex, 0);
+	glUniform1f(shader->alpha, 1.0);
+	shader->alpha_value = 1.0;
+}
+
 extern const GLchar quad_vertex_src[];
 extern const GLchar quad_fragment_src[];
 extern const GLchar tex_vertex_src[];
@@ -724,6 +1072,7 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 
 	wl_list_init(&renderer->buffers);
 	wl_list_init(&renderer->textures);
+	wl_array_init(&renderer->vertices);
 
 	renderer->egl = egl;
 	renderer->exts_str = exts_str;
@@ -780,6 +1129,51 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 			"glEGLImageTargetRenderbufferStorageOES");
 	}
 
+	int gl_major = 0;
+	const char *version_str = (const char *)glGetString(GL_VERSION);
+	if (version_str != NULL) {
+		sscanf(version_str, "OpenGL ES %d", &gl_major);
+	}
+	if (gl_major >= 3) {
+		renderer->exts.staged_upload = true;
+		load_gl_proc(&renderer->procs.glMapBufferRangeEXT, "glMapBufferRange");
+		load_gl_proc(&renderer->procs.glUnmapBufferOES, "glUnmapBuffer");
+		load_gl_proc(&renderer->procs.glFenceSyncAPPLE, "glFenceSync");
+		load_gl_proc(&renderer->procs.glClientWaitSyncAPPLE,
+			"glClientWaitSync");
+		load_gl_proc(&renderer->procs.glDeleteSyncAPPLE, "glDeleteSync");
+	} else if (check_gl_ext(exts_str, "GL_NV_pixel_buffer_object") &&
+			check_gl_ext(exts_str, "GL_EXT_map_buffer_range") &&
+			check_gl_ext(exts_str, "GL_OES_mapbuffer") &&
+			check_gl_ext(exts_str, "GL_APPLE_sync")) {
+		renderer->exts.staged_upload = true;
+		load_gl_proc(&renderer->procs.glMapBufferRangeEXT,
+			"glMapBufferRangeEXT");
+		load_gl_proc(&renderer->procs.glUnmapBufferOES, "glUnmapBufferOES");
+		load_gl_proc(&renderer->procs.glFenceSyncAPPLE, "glFenceSyncAPPLE");
+		load_gl_proc(&renderer->procs.glClientWaitSyncAPPLE,
+			"glClientWaitSyncAPPLE");
+		load_gl_proc(&renderer->procs.glDeleteSyncAPPLE, "glDeleteSyncAPPLE");
+	}
+
+	if (check_gl_ext(exts_str, "GL_EXT_disjoint_timer_query")) {
+		load_gl_proc(&renderer->procs.glGenQueriesEXT, "glGenQueriesEXT");
+		load_gl_proc(&renderer->procs.glDeleteQueriesEXT,
+			"glDeleteQueriesEXT");
+		load_gl_proc(&renderer->procs.glQueryCounterEXT, "glQueryCounterEXT");
+		load_gl_proc(&renderer->procs.glGetQueryivEXT, "glGetQueryivEXT");
+		load_gl_proc(&renderer->procs.glGetQueryObjectivEXT,
+			"glGetQueryObjectivEXT");
+		load_gl_proc(&renderer->procs.glGetQueryObjectui64vEXT,
+			"glGetQueryObjectui64vEXT");
+
+		// Timestamp queries are optional
+		GLint bits = 0;
+		renderer->procs.glGetQueryivEXT(GL_TIMESTAMP_EXT,
+			GL_QUERY_COUNTER_BITS_EXT, &bits);
+		renderer->exts.EXT_disjoint_timer_query = bits > 0;
+	}
+
 	if (renderer->exts.KHR_debug) {
 		glEnable(GL_DEBUG_OUTPUT_KHR);
 		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR);
@@ -800,46 +1194,44 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 	if (!renderer->shaders.quad.program) {
 		goto error;
 	}
-	renderer->shaders.quad.proj = glGetUniformLocation(prog, "proj");
 	renderer->shaders.quad.color = glGetUniformLocation(prog, "color");
-	renderer->shaders.quad.pos_attrib = glGetAttribLocation(prog, "pos");
+	glUseProgram(prog);
+	glUniform4f(renderer->shaders.quad.color, 0, 0, 0, 0);
 
-	renderer->shaders.tex_rgba.program = prog =
-		link_program(renderer, tex_vertex_src, tex_fragment_src_rgba);
-	if (!renderer->shaders.tex_rgba.program) {
+	prog = link_program(renderer, tex_vertex_src, tex_fragment_src_rgba);
+	if (!prog) {
 		goto error;
 	}
-	renderer->shaders.tex_rgba.proj = glGetUniformLocation(prog, "proj");
-	renderer->shaders.tex_rgba.invert_y = glGetUniformLocation(prog, "invert_y");
-	renderer->shaders.tex_rgba.tex = glGetUniformLocation(prog, "tex");
-	renderer->shaders.tex_rgba.alpha = glGetUniformLocation(prog, "alpha");
-	renderer->shaders.tex_rgba.pos_attrib = glGetAttribLocation(prog, "pos");
-	renderer->shaders.tex_rgba.tex_attrib = glGetAttribLocation(prog, "texcoord");
+	init_tex_shader(&renderer->shaders.tex_rgba, prog);
 
-	renderer->shaders.tex_rgbx.program = prog =
-		link_program(renderer, tex_vertex_src, tex_fragment_src_rgbx);
-	if (!renderer->shaders.tex_rgbx.program) {
+	prog = link_program(renderer, tex_vertex_src, tex_fragment_src_rgbx);
+	if (!prog) {
 		goto error;
 	}
-	renderer->shaders.tex_rgbx.proj = glGetUniformLocation(prog, "proj");
-	renderer->shaders.tex_rgbx.invert_y = glGetUniformLocation(prog, "invert_y");
-	renderer->shaders.tex_rgbx.tex = glGetUniformLocation(prog, "tex");
-	renderer->shaders.tex_rgbx.alpha = glGetUniformLocation(prog, "alpha");
-	renderer->shaders.tex_rgbx.pos_attrib = glGetAttribLocation(prog, "pos");
-	renderer->shaders.tex_rgbx.tex_attrib = glGetAttribLocation(prog, "texcoord");
+	init_tex_shader(&renderer->shaders.tex_rgbx, prog);
 
 	if (renderer->exts.OES_egl_image_external) {
-		renderer->shaders.tex_ext.program = prog =
-			link_program(renderer, tex_vertex_src, tex_fragment_src_external);
-		if (!renderer->shaders.tex_ext.program) {
+		prog = link_program(renderer, tex_vertex_src, tex_fragment_src_external);
+		if (!prog) {
 			goto error;
 		}
-		renderer->shaders.tex_ext.proj = glGetUniformLocation(prog, "proj");
-		renderer->shaders.tex_ext.invert_y = glGetUniformLocation(prog, "invert_y");
-		renderer->shaders.tex_ext.tex = glGetUniformLocation(prog, "tex");
-		renderer->shaders.tex_ext.alpha = glGetUniformLocation(prog, "alpha");
-		renderer->shaders.tex_ext.pos_attrib = glGetAttribLocation(prog, "pos");
-		renderer->shaders.tex_ext.tex_attrib = glGetAttribLocation(prog, "texcoord");
+		init_tex_shader(&renderer->shaders.tex_ext, prog);
+	}
+
+	glUseProgram(0);
+
+	glGenBuffers(1, &renderer->vbo);
+	if (renderer->exts.EXT_disjoint_timer_query) {
+		for (size_t i = 0; i < WLR_GLES2_TIMER_QUERIES; i++) {
+			struct wlr_gles2_timer_query *query = &renderer->timer_queries[i];
+			renderer->procs.glGenQueriesEXT(1, &query->begin);
+			renderer->procs.glGenQueriesEXT(1, &query->end);
+		}
+	}
+	if (renderer->exts.staged_upload) {
+		for (size_t i = 0; i < WLR_GLES2_STAGING_BUFFERS; i++) {
+			glGenBuffers(1, &renderer->staging[i].pbo);
+		}
 	}
 
 	pop_gles2_debug(renderer);
@@ -873,6 +1265,12 @@ bool wlr_gles2_renderer_check_ext(struct wlr_renderer *wlr_renderer,
 	return check_gl_ext(renderer->exts_str, ext);
 }
 
+void wlr_gles2_renderer_get_upload_stats(struct wlr_renderer *wlr_renderer,
+		struct wlr_gles2_upload_stats *stats) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+	*stats = renderer->upload_stats;
+}
+
 GLuint wlr_gles2_renderer_get_current_fbo(struct wlr_renderer *wlr_renderer) {
 	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
 	assert(renderer->current_buffer);
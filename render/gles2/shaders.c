@@ -3,7 +3,6 @@
 
 // Colored quads
 const GLchar quad_vertex_src[] =
-"uniform mat3 proj;\n"
 "uniform vec4 color;\n"
 "attribute vec2 pos;\n"
 "attribute vec2 texcoord;\n"
@@ -11,7 +10,7 @@ const GLchar quad_vertex_src[] =
 "varying vec2 v_texcoord;\n"
 "\n"
 "void main() {\n"
-"	gl_Position = vec4(proj * vec3(pos, 1.0), 1.0);\n"
+"	gl_Position = vec4(pos, 0.0, 1.0);\n"
 "	v_color = color;\n"
 "	v_texcoord = texcoord;\n"
 "}\n";
@@ -27,48 +26,51 @@ const GLchar quad_fragment_src[] =
 
 // Textured quads
 const GLchar tex_vertex_src[] =
-"uniform mat3 proj;\n"
-"uniform bool invert_y;\n"
 "attribute vec2 pos;\n"
 "attribute vec2 texcoord;\n"
+"attribute vec4 texclamp;\n"
 "varying vec2 v_texcoord;\n"
+"varying vec4 v_texclamp;\n"
 "\n"
 "void main() {\n"
-"	gl_Position = vec4(proj * vec3(pos, 1.0), 1.0);\n"
-"	if (invert_y) {\n"
-"		v_texcoord = vec2(texcoord.x, 1.0 - texcoord.y);\n"
-"	} else {\n"
-"		v_texcoord = texcoord;\n"
-"	}\n"
+"	gl_Position = vec4(pos, 0.0, 1.0);\n"
+"	v_texcoord = texcoord;\n"
+"	v_texclamp = texclamp;\n"
 "}\n";
 
 const GLchar tex_fragment_src_rgba[] =
 "precision mediump float;\n"
 "varying vec2 v_texcoord;\n"
+"varying vec4 v_texclamp;\n"
 "uniform sampler2D tex;\n"
 "uniform float alpha;\n"
 "\n"
 "void main() {\n"
-"	gl_FragColor = texture2D(tex, v_texcoord) * alpha;\n"
+"	vec2 texcoord = clamp(v_texcoord, v_texclamp.xy, v_texclamp.zw);\n"
+"	gl_FragColor = texture2D(tex, texcoord) * alpha;\n"
 "}\n";
 
 const GLchar tex_fragment_src_rgbx[] =
 "precision mediump float;\n"
 "varying vec2 v_texcoord;\n"
+"varying vec4 v_texclamp;\n"
 "uniform sampler2D tex;\n"
 "uniform float alpha;\n"
 "\n"
 "void main() {\n"
-"	gl_FragColor = vec4(texture2D(tex, v_texcoord).rgb, 1.0) * alpha;\n"
+"	vec2 texcoord = clamp(v_texcoord, v_texclamp.xy, v_texclamp.zw);\n"
+"	gl_FragColor = vec4(texture2D(tex, texcoord).rgb, 1.0) * alpha;\n"
 "}\n";
 
 const GLchar tex_fragment_src_external[] =
 "#extension GL_OES_EGL_image_external : require\n\n"
 "precision mediump float;\n"
 "varying vec2 v_texcoord;\n"
+"varying vec4 v_texclamp;\n"
 "uniform samplerExternalOES texture0;\n"
 "uniform float alpha;\n"
 "\n"
 "void main() {\n"
-"	gl_FragColor = texture2D(texture0, v_texcoord) * alpha;\n"
+"	vec2 texcoord = clamp(v_texcoord, v_texclamp.xy, v_texclamp.zw);\n"
+"	gl_FragColor = texture2D(texture0, texcoord) * alpha;\n"
 "}\n";
@@ -4,6 +4,7 @@
 #include <GLES2/gl2ext.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wayland-server-protocol.h>
 #include <wayland-util.h>
 #include <wlr/render/egl.h>
@@ -49,6 +50,83 @@ static bool check_stride(const struct wlr_pixel_format_info *fmt,
 	return true;
 }
 
+/**
+ * Upload pixels to the bound texture through the next staging buffer: the
+ * data is copied to the buffer, and the GPU copies it to the texture
+ * asynchronously. Returns false if no staging buffer is available, in which
+ * case the caller needs to upload the pixels directly.
+ */
+static bool write_pixels_staged(struct wlr_gles2_renderer *renderer,
+		const struct wlr_gles2_pixel_format *fmt,
+		const struct wlr_pixel_format_info *drm_fmt, uint32_t stride,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
+		uint32_t dst_x, uint32_t dst_y, const void *data) {
+	if (!renderer->exts.staged_upload) {
+		return false;
+	}
+
+	struct wlr_gles2_staging_buffer *staging =
+		&renderer->staging[renderer->staging_next];
+	if (staging->fence != NULL) {
+		// Don't wait for the GPU: if the buffer is still in use, the ring
+		// is too short for the current upload rate
+		GLenum status =
+			renderer->procs.glClientWaitSyncAPPLE(staging->fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED_APPLE &&
+				status != GL_CONDITION_SATISFIED_APPLE) {
+			return false;
+		}
+		renderer->procs.glDeleteSyncAPPLE(staging->fence);
+		staging->fence = NULL;
+	}
+	renderer->staging_next =
+		(renderer->staging_next + 1) % WLR_GLES2_STAGING_BUFFERS;
+
+	// Rows are tightly packed, with the default GL_UNPACK_ALIGNMENT of 4
+	size_t bytes_per_pixel = drm_fmt->bpp / 8;
+	size_t row_size = width * bytes_per_pixel;
+	size_t pitch = (row_size + 3) & ~(size_t)3;
+	GLsizeiptr size = pitch * height;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, staging->pbo);
+	if (staging->size < size) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER_NV, size, NULL, GL_STREAM_DRAW);
+		staging->size = size;
+	}
+
+	// The fence guarantees the GPU is done with the previous contents
+	uint8_t *map = renderer->procs.glMapBufferRangeEXT(
+		GL_PIXEL_UNPACK_BUFFER_NV, 0, size, GL_MAP_WRITE_BIT_EXT |
+		GL_MAP_INVALIDATE_BUFFER_BIT_EXT | GL_MAP_UNSYNCHRONIZED_BIT_EXT);
+	if (map == NULL) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, 0);
+		return false;
+	}
+
+	const uint8_t *src = (const uint8_t *)data + src_y * stride +
+		src_x * bytes_per_pixel;
+	for (uint32_t i = 0; i < height; i++) {
+		memcpy(map + i * pitch, src + i * stride, row_size);
+	}
+
+	if (!renderer->procs.glUnmapBufferOES(GL_PIXEL_UNPACK_BUFFER_NV)) {
+		// The buffer contents have been lost
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, 0);
+		return false;
+	}
+
+	glTexSubImage2D(GL_TEXTURE_2D, 0, dst_x, dst_y, width, height,
+		fmt->gl_format, fmt->gl_type, NULL);
+	staging->fence = renderer->procs.glFenceSyncAPPLE(
+		GL_SYNC_GPU_COMMANDS_COMPLETE_APPLE, 0);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, 0);
+
+	renderer->upload_stats.staged_uploads++;
+	renderer->upload_stats.staged_bytes += (uint64_t)row_size * height;
+	return true;
+}
+
 static bool gles2_texture_write_pixels(struct wlr_texture *wlr_texture,
 		uint32_t stride, uint32_t width, uint32_t height,
 		uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y,
@@ -78,20 +156,27 @@ static bool gles2_texture_write_pixels(struct wlr_texture *wlr_texture,
 
 	push_gles2_debug(texture->renderer);
 
-	glBindTexture(GL_TEXTURE_2D, texture->tex);
+	gles2_bind_texture(texture->renderer, GL_TEXTURE_2D, texture->tex);
 
-	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / (drm_fmt->bpp / 8));
-	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, src_x);
-	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, src_y);
+	if (!write_pixels_staged(texture->renderer, fmt, drm_fmt, stride,
+			width, height, src_x, src_y, dst_x, dst_y, data)) {
+		glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / (drm_fmt->bpp / 8));
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, src_x);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, src_y);
 
-	glTexSubImage2D(GL_TEXTURE_2D, 0, dst_x, dst_y, width, height,
-		fmt->gl_format, fmt->gl_type, data);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, dst_x, dst_y, width, height,
+			fmt->gl_format, fmt->gl_type, data);
 
-	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
-	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
-	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+	}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	struct wlr_gles2_upload_stats *stats = &texture->renderer->upload_stats;
+	stats->uploads++;
+	stats->bytes += (uint64_t)width * height * (drm_fmt->bpp / 8);
+
+	gles2_bind_texture(texture->renderer, GL_TEXTURE_2D, 0);
 
 	pop_gles2_debug(texture->renderer);
 
@@ -115,10 +200,10 @@ static bool gles2_texture_invalidate(struct wlr_gles2_texture *texture) {
 
 	push_gles2_debug(texture->renderer);
 
-	glBindTexture(texture->target, texture->tex);
+	gles2_bind_texture(texture->renderer, texture->target, texture->tex);
 	texture->renderer->procs.glEGLImageTargetTexture2DOES(texture->target,
 		texture->image);
-	glBindTexture(texture->target, 0);
+	gles2_bind_texture(texture->renderer, texture->target, 0);
 
 	pop_gles2_debug(texture->renderer);
 
@@ -139,6 +224,10 @@ void gles2_texture_destroy(struct wlr_gles2_texture *texture) {
 
 	push_gles2_debug(texture->renderer);
 
+	// Deleting a bound texture reverts the binding to zero
+	if (texture->renderer->state.tex == texture->tex) {
+		texture->renderer->state.tex = 0;
+	}
 	glDeleteTextures(1, &texture->tex);
 	wlr_egl_destroy_image(texture->renderer->egl, texture->image);
 
@@ -217,8 +306,9 @@ static struct wlr_texture *gles2_texture_from_pixels(
 	push_gles2_debug(renderer);
 
 	glGenTextures(1, &texture->tex);
-	glBindTexture(GL_TEXTURE_2D, texture->tex);
+	gles2_bind_texture(renderer, GL_TEXTURE_2D, texture->tex);
 
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / (drm_fmt->bpp / 8));
@@ -226,7 +316,11 @@ static struct wlr_texture *gles2_texture_from_pixels(
 		fmt->gl_format, fmt->gl_type, data);
 	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	renderer->upload_stats.uploads++;
+	renderer->upload_stats.bytes +=
+		(uint64_t)width * height * (drm_fmt->bpp / 8);
+
+	gles2_bind_texture(renderer, GL_TEXTURE_2D, 0);
 
 	pop_gles2_debug(renderer);
 
@@ -282,11 +376,12 @@ static struct wlr_texture *gles2_texture_from_dmabuf(
 	push_gles2_debug(renderer);
 
 	glGenTextures(1, &texture->tex);
-	glBindTexture(texture->target, texture->tex);
+	gles2_bind_texture(renderer, texture->target, texture->tex);
+	glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(texture->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(texture->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	renderer->procs.glEGLImageTargetTexture2DOES(texture->target, texture->image);
-	glBindTexture(texture->target, 0);
+	gles2_bind_texture(renderer, texture->target, 0);
 
 	pop_gles2_debug(renderer);
 
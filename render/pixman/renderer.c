@@ -9,6 +9,7 @@
 #include <wlr/util/log.h>
 
 #include "render/pixman.h"
+#include "render/wlr_renderer.h"
 #include "types/wlr_buffer.h"
 
 static const struct wlr_renderer_impl renderer_impl;
@@ -51,8 +52,13 @@ static bool texture_is_opaque(struct wlr_texture *wlr_texture) {
 	return !texture->format_info->has_alpha;
 }
 
+static void pixman_flush(struct wlr_pixman_renderer *renderer);
+
 static void texture_destroy(struct wlr_texture *wlr_texture) {
 	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
+	if (texture->accessed) {
+		pixman_flush(texture->renderer);
+	}
 	wl_list_remove(&texture->link);
 	pixman_image_unref(texture->image);
 	wlr_buffer_unlock(texture->buffer);
@@ -133,11 +139,46 @@ error_buffer:
 	return NULL;
 }
 
+/**
+ * Make sure the image wraps the buffer's current pixels. The data pointer of
+ * a client buffer changes when its wl_shm_pool is resized and remapped, in
+ * which case the image is re-created. Otherwise the image is reused as is.
+ */
+static bool update_buffer_image(struct wlr_pixman_renderer *renderer,
+		pixman_image_t **image_ptr, void *data, uint32_t drm_format,
+		size_t stride, int width, int height) {
+	renderer->image_stats.accesses++;
+
+	pixman_format_code_t format = get_pixman_format_from_drm(drm_format);
+	assert(format != 0);
+
+	pixman_image_t *image = *image_ptr;
+	if (image != NULL && (void *)pixman_image_get_data(image) == data &&
+			pixman_image_get_stride(image) == (int)stride &&
+			pixman_image_get_format(image) == format) {
+		return true;
+	}
+
+	image = pixman_image_create_bits_no_clear(format, width, height,
+		data, stride);
+	if (image == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		return false;
+	}
+	if (*image_ptr != NULL) {
+		pixman_image_unref(*image_ptr);
+	}
+	*image_ptr = image;
+	renderer->image_stats.recreated++;
+	return true;
+}
+
 static void pixman_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 		uint32_t height) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
 	renderer->width = width;
 	renderer->height = height;
+	renderer->scissor = (struct wlr_box){ .width = width, .height = height };
 
 	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
 	assert(buffer != NULL);
@@ -149,16 +190,8 @@ static void pixman_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 		WLR_BUFFER_DATA_PTR_ACCESS_READ | WLR_BUFFER_DATA_PTR_ACCESS_WRITE,
 		&data, &drm_format, &stride);
 
-	// If the data pointer has changed, re-create the Pixman image. This can
-	// happen if it's a client buffer and the wl_shm_pool has been resized.
-	if (data != pixman_image_get_data(buffer->image)) {
-		pixman_format_code_t format = get_pixman_format_from_drm(drm_format);
-		assert(format != 0);
-
-		pixman_image_unref(buffer->image);
-		buffer->image = pixman_image_create_bits_no_clear(format,
-			buffer->buffer->width, buffer->buffer->height, data, stride);
-	}
+	update_buffer_image(renderer, &buffer->image, data, drm_format, stride,
+		buffer->buffer->width, buffer->buffer->height);
 }
 
 static void pixman_end(struct wlr_renderer *wlr_renderer) {
@@ -166,13 +199,55 @@ static void pixman_end(struct wlr_renderer *wlr_renderer) {
 
 	assert(renderer->current_buffer != NULL);
 
+	pixman_flush(renderer);
 	wlr_buffer_end_data_ptr_access(renderer->current_buffer->buffer);
 }
 
+static struct wlr_pixman_command *add_command(
+		struct wlr_pixman_renderer *renderer) {
+	struct wlr_pixman_command *cmd =
+		wl_array_add(&renderer->commands, sizeof(*cmd));
+	if (cmd == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	*cmd = (struct wlr_pixman_command){ .mask_alpha = 0xFFFF };
+	return cmd;
+}
+
+/**
+ * Fill a box of the render buffer with a color, or record the operation in
+ * threaded mode.
+ */
+static void render_fill(struct wlr_pixman_renderer *renderer, pixman_op_t op,
+		const struct pixman_color *colour, const struct wlr_box *box) {
+	if (wlr_box_empty(box)) {
+		return;
+	}
+
+	if (renderer->workers != NULL) {
+		struct wlr_pixman_command *cmd = add_command(renderer);
+		if (cmd != NULL) {
+			cmd->op = op;
+			cmd->box = *box;
+			cmd->color = *colour;
+		}
+		return;
+	}
+
+	pixman_box32_t rect = {
+		.x1 = box->x,
+		.y1 = box->y,
+		.x2 = box->x + box->width,
+		.y2 = box->y + box->height,
+	};
+	pixman_image_fill_boxes(op, renderer->current_buffer->image, colour,
+		1, &rect);
+}
+
 static void pixman_clear(struct wlr_renderer *wlr_renderer,
 		const float color[static 4]) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
-	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
 
 	const struct pixman_color colour = {
 		.red = color[0] * 0xFFFF,
@@ -181,27 +256,21 @@ static void pixman_clear(struct wlr_renderer *wlr_renderer,
 		.alpha = color[3] * 0xFFFF,
 	};
 
-	pixman_image_t *fill = pixman_image_create_solid_fill(&colour);
-
-	pixman_image_composite32(PIXMAN_OP_SRC, fill, NULL, buffer->image, 0, 0, 0,
-			0, 0, 0, renderer->width, renderer->height);
-
-	pixman_image_unref(fill);
+	render_fill(renderer, PIXMAN_OP_SRC, &colour, &renderer->scissor);
 }
 
 static void pixman_scissor(struct wlr_renderer *wlr_renderer,
 		struct wlr_box *box) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
-	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
 
-	if (box != NULL) {
-		struct pixman_region32 region = {0};
-		pixman_region32_init_rect(&region, box->x, box->y, box->width,
-				box->height);
-		pixman_image_set_clip_region32(buffer->image, &region);
-		pixman_region32_fini(&region);
-	} else {
-		pixman_image_set_clip_region32(buffer->image, NULL);
+	struct wlr_box target = {
+		.width = renderer->width,
+		.height = renderer->height,
+	};
+	if (box == NULL) {
+		renderer->scissor = target;
+	} else if (!wlr_box_intersection(&renderer->scissor, box, &target)) {
+		renderer->scissor = (struct wlr_box){0};
 	}
 }
 
@@ -221,82 +290,338 @@ static void matrix_to_pixman_transform(struct pixman_transform *transform,
 	pixman_transform_from_pixman_f_transform(transform, &ftr);
 }
 
-static bool pixman_render_subtexture_with_matrix(
-		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
-		const struct wlr_fbox *fbox, const float matrix[static 9],
-		float alpha) {
-	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
-	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
-	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
+static bool is_integer(float v) {
+	return fabs(v - round(v)) < 1e-4;
+}
 
-	if (texture->buffer != NULL) {
-		void *data;
-		uint32_t drm_format;
-		size_t stride;
-		if (!wlr_buffer_begin_data_ptr_access(texture->buffer,
-				WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &drm_format, &stride)) {
-			return false;
-		}
+/**
+ * Round a coordinate towards -inf or +inf, ignoring floating point errors.
+ */
+static int floor_coord(float v) {
+	return is_integer(v) ? round(v) : floor(v);
+}
+
+static int ceil_coord(float v) {
+	return is_integer(v) ? round(v) : ceil(v);
+}
+
+/**
+ * Get the smallest box containing the quad drawn by a matrix, i.e. the image
+ * of the unit square.
+ */
+static void get_quad_bounds(const float matrix[static 9], struct wlr_box *box) {
+	float x1 = matrix[2], y1 = matrix[5];
+	float x2 = x1, y2 = y1;
+	const float corners[][2] = { { 1, 0 }, { 0, 1 }, { 1, 1 } };
+	for (size_t i = 0; i < sizeof(corners) / sizeof(corners[0]); i++) {
+		float x = matrix[0] * corners[i][0] + matrix[1] * corners[i][1] +
+			matrix[2];
+		float y = matrix[3] * corners[i][0] + matrix[4] * corners[i][1] +
+			matrix[5];
+		x1 = fmin(x1, x);
+		y1 = fmin(y1, y);
+		x2 = fmax(x2, x);
+		y2 = fmax(y2, y);
+	}
+
+	box->x = floor_coord(x1);
+	box->y = floor_coord(y1);
+	box->width = ceil_coord(x2) - box->x;
+	box->height = ceil_coord(y2) - box->y;
+}
+
+/**
+ * Check whether the quad drawn by a matrix exactly covers its pixel-aligned
+ * bounding box.
+ */
+static bool is_quad_pixel_aligned(const float matrix[static 9]) {
+	bool axis_aligned = (matrix[1] == 0.0 && matrix[3] == 0.0) ||
+		(matrix[0] == 0.0 && matrix[4] == 0.0);
+	return axis_aligned && is_integer(matrix[0]) && is_integer(matrix[1]) &&
+		is_integer(matrix[2]) && is_integer(matrix[3]) &&
+		is_integer(matrix[4]) && is_integer(matrix[5]);
+}
+
+/**
+ * A source image ready to be composited onto the render buffer.
+ */
+struct pixman_draw {
+	pixman_image_t *src, *mask;
+	uint16_t mask_alpha; // 0xFFFF without mask
+	pixman_op_t op;
+	struct wlr_box bounds; // destination area covered by the quad
+	bool translated; // the source isn't transformed, only offset
+	int src_x, src_y; // source position of the destination origin
+	struct pixman_transform transform; // if not translated
+};
 
-		// If the data pointer has changed, re-create the Pixman image. This can
-		// happen if it's a client buffer and the wl_shm_pool has been resized.
-		if (data != pixman_image_get_data(texture->image)) {
-			pixman_format_code_t format = get_pixman_format_from_drm(drm_format);
-			assert(format != 0);
+/**
+ * Prepare compositing an image onto the render buffer. quad_matrix draws the
+ * destination quad, and src_matrix maps source pixels to destination pixels.
+ *
+ * When the source is only translated by whole pixels, no transform is set on
+ * the image so that pixman can use its fast non-transformed paths.
+ */
+static void draw_init(struct pixman_draw *draw, pixman_image_t *src,
+		pixman_image_t *mask, const float quad_matrix[static 9],
+		const float src_matrix[static 9]) {
+	*draw = (struct pixman_draw){
+		.src = src,
+		.mask = mask,
+		.mask_alpha = 0xFFFF,
+		.op = PIXMAN_OP_OVER,
+	};
+	get_quad_bounds(quad_matrix, &draw->bounds);
+
+	if (fabs(src_matrix[0] - 1.0) < 1e-4 && fabs(src_matrix[1]) < 1e-4 &&
+			fabs(src_matrix[3]) < 1e-4 && fabs(src_matrix[4] - 1.0) < 1e-4 &&
+			is_integer(src_matrix[2]) && is_integer(src_matrix[5])) {
+		pixman_image_set_transform(src, NULL);
+		draw->translated = true;
+		draw->src_x = -round(src_matrix[2]);
+		draw->src_y = -round(src_matrix[5]);
+		return;
+	}
 
-			pixman_image_unref(texture->image);
-			texture->image = pixman_image_create_bits_no_clear(format,
-				texture->wlr_texture.width, texture->wlr_texture.height,
-				data, stride);
+	matrix_to_pixman_transform(&draw->transform, src_matrix);
+	pixman_transform_invert(&draw->transform, &draw->transform);
+	pixman_image_set_transform(src, &draw->transform);
+}
+
+/**
+ * Composite the prepared image, restricted to the clip box and to the
+ * destination bounds of the quad. In threaded mode, the operation is recorded
+ * instead.
+ */
+static void draw_composite(struct wlr_pixman_renderer *renderer,
+		const struct pixman_draw *draw, const struct wlr_box *clip) {
+	struct wlr_box box;
+	if (!wlr_box_intersection(&box, &draw->bounds, clip)) {
+		return;
+	}
+
+	if (renderer->workers != NULL) {
+		struct wlr_pixman_command *cmd = add_command(renderer);
+		if (cmd == NULL) {
+			return;
 		}
+		cmd->op = draw->op;
+		cmd->box = box;
+		cmd->src = pixman_image_ref(draw->src);
+		cmd->src_format = pixman_image_get_format(draw->src);
+		cmd->src_bits = pixman_image_get_data(draw->src);
+		cmd->src_width = pixman_image_get_width(draw->src);
+		cmd->src_height = pixman_image_get_height(draw->src);
+		cmd->src_stride = pixman_image_get_stride(draw->src);
+		cmd->src_x = draw->src_x;
+		cmd->src_y = draw->src_y;
+		cmd->transform = draw->transform;
+		cmd->has_transform = !draw->translated;
+		cmd->mask_alpha = draw->mask_alpha;
+		return;
 	}
 
-	// TODO: don't create a mask if alpha == 1.0
-	struct pixman_color mask_colour = {0};
-	mask_colour.alpha = 0xFFFF * alpha;
-	pixman_image_t *mask = pixman_image_create_solid_fill(&mask_colour);
+	pixman_image_composite32(draw->op, draw->src, draw->mask,
+		renderer->current_buffer->image,
+		box.x + draw->src_x, box.y + draw->src_y, 0, 0, box.x, box.y,
+		box.width, box.height);
+}
 
-	float m[9];
-	memcpy(m, matrix, sizeof(m));
-	wlr_matrix_scale(m, 1.0 / fbox->width, 1.0 / fbox->height);
+static bool begin_texture_access(struct wlr_pixman_texture *texture) {
+	if (texture->buffer == NULL) {
+		return true;
+	}
 
-	struct pixman_transform transform = {0};
-	matrix_to_pixman_transform(&transform, m);
-	pixman_transform_invert(&transform, &transform);
+	void *data;
+	uint32_t drm_format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(texture->buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &drm_format, &stride)) {
+		return false;
+	}
 
-	pixman_image_set_transform(texture->image, &transform);
+	if (!update_buffer_image(texture->renderer, &texture->image, data,
+			drm_format, stride, texture->wlr_texture.width,
+			texture->wlr_texture.height)) {
+		wlr_buffer_end_data_ptr_access(texture->buffer);
+		return false;
+	}
 
-	// TODO clip properly with src_x and src_y
-	pixman_image_composite32(PIXMAN_OP_OVER, texture->image, mask,
-			buffer->image, 0, 0, 0, 0, 0, 0, renderer->width,
-			renderer->height);
+	return true;
+}
 
+static void end_texture_access(struct wlr_pixman_texture *texture) {
 	if (texture->buffer != NULL) {
 		wlr_buffer_end_data_ptr_access(texture->buffer);
 	}
+}
 
-	pixman_image_unref(mask);
+/**
+ * Start accessing a texture's data for a draw. In threaded mode, the data is
+ * accessed until the recorded commands are run.
+ */
+static bool begin_draw_texture(struct wlr_pixman_renderer *renderer,
+		struct wlr_pixman_texture *texture) {
+	if (renderer->workers == NULL) {
+		return begin_texture_access(texture);
+	}
+	if (texture->accessed) {
+		return true;
+	}
 
+	struct wlr_pixman_texture **entry =
+		wl_array_add(&renderer->accessed_textures, sizeof(*entry));
+	if (entry == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	if (!begin_texture_access(texture)) {
+		renderer->accessed_textures.size -= sizeof(*entry);
+		return false;
+	}
+	*entry = texture;
+	texture->accessed = true;
 	return true;
 }
 
-static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
-		const float color[static 4], const float matrix[static 9]) {
+static void end_draw_texture(struct wlr_pixman_renderer *renderer,
+		struct wlr_pixman_texture *texture) {
+	if (renderer->workers == NULL) {
+		end_texture_access(texture);
+	}
+}
+
+/**
+ * Run the commands recorded in threaded mode.
+ */
+static void pixman_flush(struct wlr_pixman_renderer *renderer) {
+	struct wlr_pixman_command *cmds = renderer->commands.data;
+	size_t cmds_len = renderer->commands.size / sizeof(cmds[0]);
+	if (cmds_len > 0) {
+		pixman_workers_run(renderer->workers,
+			renderer->current_buffer->image, cmds, cmds_len);
+	}
+
+	for (size_t i = 0; i < cmds_len; i++) {
+		if (cmds[i].src != NULL) {
+			pixman_image_unref(cmds[i].src);
+		}
+	}
+	renderer->commands.size = 0;
+
+	struct wlr_pixman_texture **texture;
+	wl_array_for_each(texture, &renderer->accessed_textures) {
+		end_texture_access(*texture);
+		(*texture)->accessed = false;
+	}
+	renderer->accessed_textures.size = 0;
+}
+
+static int get_alpha_mask_index(float alpha) {
+	int index = round(alpha * 0xFF);
+	if (index < 0) {
+		return 0;
+	}
+	return index;
+}
+
+static uint16_t get_mask_alpha(float alpha) {
+	return get_alpha_mask_index(alpha) * 0x101;
+}
+
+/**
+ * Get the mask image to apply an alpha multiplier, or NULL if none is
+ * needed. Masks are cached by the renderer for each 8-bit alpha value.
+ */
+static pixman_image_t *get_alpha_mask(struct wlr_pixman_renderer *renderer,
+		float alpha) {
+	int index = get_alpha_mask_index(alpha);
+	if (index >= 0xFF) {
+		return NULL;
+	}
+
+	if (renderer->alpha_masks[index] == NULL) {
+		struct pixman_color mask_colour = {0};
+		mask_colour.alpha = get_mask_alpha(alpha);
+		renderer->alpha_masks[index] =
+			pixman_image_create_solid_fill(&mask_colour);
+	}
+	return renderer->alpha_masks[index];
+}
+
+/**
+ * Prepare compositing a texture. The caller needs to have begun accessing
+ * the texture.
+ */
+static void texture_draw_init(struct pixman_draw *draw,
+		struct wlr_pixman_renderer *renderer,
+		struct wlr_pixman_texture *texture, const struct wlr_fbox *fbox,
+		const float matrix[static 9], float alpha) {
+	float src_matrix[9];
+	memcpy(src_matrix, matrix, sizeof(src_matrix));
+	wlr_matrix_scale(src_matrix, 1.0 / fbox->width, 1.0 / fbox->height);
+	wlr_matrix_translate(src_matrix, -fbox->x, -fbox->y);
+
+	pixman_image_t *mask = get_alpha_mask(renderer, alpha);
+	draw_init(draw, texture->image, mask, matrix, src_matrix);
+	if (mask != NULL) {
+		draw->mask_alpha = get_mask_alpha(alpha);
+	}
+
+	// Opaque textures can be copied as-is, as long as every destination
+	// pixel is covered by the source image
+	struct wlr_box src_box = {
+		.x = draw->bounds.x + draw->src_x,
+		.y = draw->bounds.y + draw->src_y,
+		.width = draw->bounds.width,
+		.height = draw->bounds.height,
+	};
+	if (mask == NULL && draw->translated &&
+			texture_is_opaque(&texture->wlr_texture) &&
+			src_box.x >= 0 && src_box.y >= 0 &&
+			src_box.x + src_box.width <= (int)texture->wlr_texture.width &&
+			src_box.y + src_box.height <= (int)texture->wlr_texture.height) {
+		draw->op = PIXMAN_OP_SRC;
+	}
+}
+
+static bool pixman_render_subtexture_with_matrix(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *fbox, const float matrix[static 9],
+		float alpha) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
-	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
+	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
 
-	struct pixman_color colour = {
+	if (!begin_draw_texture(renderer, texture)) {
+		return false;
+	}
+
+	struct pixman_draw draw;
+	texture_draw_init(&draw, renderer, texture, fbox, matrix, alpha);
+	draw_composite(renderer, &draw, &renderer->scissor);
+
+	end_draw_texture(renderer, texture);
+
+	return true;
+}
+
+static struct pixman_color color_to_pixman(const float color[static 4]) {
+	return (struct pixman_color){
 		.red = color[0] * 0xFFFF,
 		.green = color[1] * 0xFFFF,
 		.blue = color[2] * 0xFFFF,
 		.alpha = color[3] * 0xFFFF,
 	};
+}
 
+/**
+ * Create an image filled with the color, and prepare compositing it.
+ */
+static void quad_draw_init(struct pixman_draw *draw,
+		const float color[static 4], const float matrix[static 9]) {
+	struct pixman_color colour = color_to_pixman(color);
 	pixman_image_t *fill = pixman_image_create_solid_fill(&colour);
 
-	float m[9];
-	memcpy(m, matrix, sizeof(m));
-
 	// TODO get the width/height from the caller instead of extracting them
 	float width, height;
 	if (matrix[1] == 0.0 && matrix[3] == 0.0) {
@@ -307,8 +632,6 @@ static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 		height = sqrt(matrix[3] * matrix[3] + matrix[4] * matrix[4]);
 	}
 
-	wlr_matrix_scale(m, 1.0 / width, 1.0 / height);
-
 	pixman_image_t *image = pixman_image_create_bits(PIXMAN_a8r8g8b8, width,
 			height, NULL, 0);
 
@@ -317,16 +640,105 @@ static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 		0, 0, 0, 0, 0, 0, width, height);
 	pixman_image_unref(fill);
 
-	struct pixman_transform transform = {0};
-	matrix_to_pixman_transform(&transform, m);
-	pixman_transform_invert(&transform, &transform);
+	float src_matrix[9];
+	memcpy(src_matrix, matrix, sizeof(src_matrix));
+	wlr_matrix_scale(src_matrix, 1.0 / width, 1.0 / height);
+
+	draw_init(draw, image, NULL, matrix, src_matrix);
+}
+
+/**
+ * Fill the quad drawn by a matrix, restricted to the clip box. The quad must
+ * be pixel-aligned.
+ */
+static void fill_quad(struct wlr_pixman_renderer *renderer,
+		const float color[static 4], const float matrix[static 9],
+		const struct wlr_box *clip) {
+	struct wlr_box bounds, box;
+	get_quad_bounds(matrix, &bounds);
+	if (!wlr_box_intersection(&box, &bounds, clip)) {
+		return;
+	}
 
-	pixman_image_set_transform(image, &transform);
+	struct pixman_color colour = color_to_pixman(color);
+	pixman_op_t op = color[3] == 1.0 ? PIXMAN_OP_SRC : PIXMAN_OP_OVER;
+	render_fill(renderer, op, &colour, &box);
+}
 
-	pixman_image_composite32(PIXMAN_OP_OVER, image, NULL, buffer->image,
-			0, 0, 0, 0, 0, 0, renderer->width, renderer->height);
+static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+
+	// Pixel-aligned rectangles don't need an intermediate image
+	if (is_quad_pixel_aligned(matrix)) {
+		fill_quad(renderer, color, matrix, &renderer->scissor);
+		return;
+	}
 
-	pixman_image_unref(image);
+	struct pixman_draw draw;
+	quad_draw_init(&draw, color, matrix);
+	draw_composite(renderer, &draw, &renderer->scissor);
+	pixman_image_unref(draw.src);
+}
+
+static bool pixman_render_quads(struct wlr_renderer *wlr_renderer,
+		const struct wlr_render_quad *quads, size_t quads_len) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+
+	// The scissor box is replaced by the per-quad clip boxes
+	pixman_scissor(wlr_renderer, NULL);
+	struct wlr_box target = renderer->scissor;
+
+	bool ok = true;
+	size_t i = 0;
+	while (i < quads_len) {
+		const struct wlr_render_quad *quad = &quads[i];
+		size_t run_len = 1;
+		while (i + run_len < quads_len &&
+				render_quads_share_state(quad, &quads[i + run_len])) {
+			run_len++;
+		}
+
+		struct pixman_draw draw = {0};
+		struct wlr_pixman_texture *texture = NULL;
+		bool fill = false;
+		if (quad->texture != NULL) {
+			texture = get_texture(quad->texture);
+			if (!begin_draw_texture(renderer, texture)) {
+				ok = false;
+				i += run_len;
+				continue;
+			}
+			texture_draw_init(&draw, renderer, texture, &quad->src_box,
+				quad->matrix, quad->alpha);
+		} else if (is_quad_pixel_aligned(quad->matrix)) {
+			fill = true;
+		} else {
+			quad_draw_init(&draw, quad->color, quad->matrix);
+		}
+
+		for (size_t j = i; j < i + run_len; j++) {
+			struct wlr_box clip;
+			if (!wlr_box_intersection(&clip, &quads[j].clip, &target)) {
+				continue;
+			}
+			if (fill) {
+				fill_quad(renderer, quad->color, quad->matrix, &clip);
+			} else {
+				draw_composite(renderer, &draw, &clip);
+			}
+		}
+
+		if (texture != NULL) {
+			end_draw_texture(renderer, texture);
+		} else if (!fill) {
+			pixman_image_unref(draw.src);
+		}
+
+		i += run_len;
+	}
+
+	return ok;
 }
 
 static const uint32_t *pixman_get_shm_texture_formats(
@@ -411,6 +823,7 @@ static bool pixman_bind_buffer(struct wlr_renderer *wlr_renderer,
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
 
 	if (renderer->current_buffer != NULL) {
+		pixman_flush(renderer);
 		wlr_buffer_unlock(renderer->current_buffer->buffer);
 		renderer->current_buffer = NULL;
 	}
@@ -436,6 +849,13 @@ static bool pixman_bind_buffer(struct wlr_renderer *wlr_renderer,
 static void pixman_destroy(struct wlr_renderer *wlr_renderer) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
 
+	if (renderer->current_buffer != NULL) {
+		pixman_flush(renderer);
+	}
+	pixman_workers_destroy(renderer->workers);
+	wl_array_release(&renderer->commands);
+	wl_array_release(&renderer->accessed_textures);
+
 	struct wlr_pixman_buffer *buffer, *buffer_tmp;
 	wl_list_for_each_safe(buffer, buffer_tmp, &renderer->buffers, link) {
 		destroy_buffer(buffer);
@@ -446,6 +866,13 @@ static void pixman_destroy(struct wlr_renderer *wlr_renderer) {
 		wlr_texture_destroy(&tex->wlr_texture);
 	}
 
+	for (size_t i = 0; i < sizeof(renderer->alpha_masks) /
+			sizeof(renderer->alpha_masks[0]); i++) {
+		if (renderer->alpha_masks[i] != NULL) {
+			pixman_image_unref(renderer->alpha_masks[i]);
+		}
+	}
+
 	wlr_drm_format_set_finish(&renderer->drm_formats);
 
 	free(renderer);
@@ -479,6 +906,8 @@ static bool pixman_read_pixels(struct wlr_renderer *wlr_renderer,
 		drm_get_pixel_format_info(drm_format);
 	assert(drm_fmt);
 
+	pixman_flush(renderer);
+
 	pixman_image_t *dst = pixman_image_create_bits_no_clear(fmt, width, height,
 			data, stride);
 
@@ -501,6 +930,7 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.scissor = pixman_scissor,
 	.render_subtexture_with_matrix = pixman_render_subtexture_with_matrix,
 	.render_quad_with_matrix = pixman_render_quad_with_matrix,
+	.render_quads = pixman_render_quads,
 	.get_shm_texture_formats = pixman_get_shm_texture_formats,
 	.get_render_formats = pixman_get_render_formats,
 	.texture_from_buffer = pixman_texture_from_buffer,
@@ -511,6 +941,22 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.get_render_buffer_caps = pixman_get_render_buffer_caps,
 };
 
+static size_t parse_threads_env(const char *name) {
+	const char *threads_str = getenv(name);
+	if (threads_str == NULL) {
+		return 1;
+	}
+
+	char *end;
+	int threads = (int)strtol(threads_str, &end, 10);
+	if (*end || threads < 1) {
+		wlr_log(WLR_ERROR, "%s specified with invalid integer, ignoring", name);
+		return 1;
+	}
+
+	return threads;
+}
+
 struct wlr_renderer *wlr_pixman_renderer_create(void) {
 	struct wlr_pixman_renderer *renderer =
 		calloc(1, sizeof(struct wlr_pixman_renderer));
@@ -522,6 +968,17 @@ struct wlr_renderer *wlr_pixman_renderer_create(void) {
 	wlr_renderer_init(&renderer->wlr_renderer, &renderer_impl);
 	wl_list_init(&renderer->buffers);
 	wl_list_init(&renderer->textures);
+	wl_array_init(&renderer->commands);
+	wl_array_init(&renderer->accessed_textures);
+
+	size_t threads = parse_threads_env("WLR_PIXMAN_THREADS");
+	if (threads > 1) {
+		renderer->workers = pixman_workers_create(threads - 1);
+		if (renderer->workers != NULL) {
+			wlr_log(WLR_INFO, "Using %zu threads for pixman rendering",
+				threads);
+		}
+	}
 
 	size_t len = 0;
 	const uint32_t *formats = get_pixman_drm_formats(&len);
@@ -539,9 +996,17 @@ pixman_image_t *wlr_pixman_texture_get_image(struct wlr_texture *wlr_texture) {
 	return texture->image;
 }
 
+void wlr_pixman_renderer_get_image_stats(struct wlr_renderer *wlr_renderer,
+		struct wlr_pixman_image_stats *stats) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+	*stats = renderer->image_stats;
+}
+
 pixman_image_t *wlr_pixman_renderer_get_current_image(
 		struct wlr_renderer *wlr_renderer) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
 	assert(renderer->current_buffer);
+	// The caller may access the image directly
+	pixman_flush(renderer);
 	return renderer->current_buffer->image;
 }
@@ -0,0 +1,296 @@
+#include <assert.h>
+#include <pixman.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+#define TILE_SIZE 128
+
+struct pixman_job {
+	const struct wlr_pixman_command *commands;
+	size_t commands_len;
+	pixman_format_code_t format;
+	uint32_t *bits;
+	int width, height, stride;
+
+	struct wlr_box area; // union of the commands' destination boxes
+	int tiles_x, tiles_y;
+	atomic_int next_tile;
+};
+
+struct wlr_pixman_workers {
+	pthread_mutex_t lock;
+	pthread_cond_t job_cond; // a job has been submitted, or stop is set
+	pthread_cond_t done_cond; // a thread has finished its share of a job
+	bool stop;
+
+	pthread_t *threads;
+	size_t threads_len;
+
+	struct pixman_job *job;
+	uint64_t job_seq;
+	size_t running; // threads still working on the current job
+};
+
+/**
+ * Images used by a single thread. Pixman images aren't thread-safe, so every
+ * thread wraps the destination and source pixels with its own images.
+ */
+struct pixman_job_context {
+	pixman_image_t *dest;
+	pixman_image_t **srcs; // by command
+	pixman_image_t **masks; // by command
+};
+
+static pixman_image_t *get_command_src(struct pixman_job_context *ctx,
+		const struct wlr_pixman_command *cmd, size_t i) {
+	if (ctx->srcs[i] == NULL) {
+		ctx->srcs[i] = pixman_image_create_bits_no_clear(cmd->src_format,
+			cmd->src_width, cmd->src_height, cmd->src_bits, cmd->src_stride);
+		if (ctx->srcs[i] != NULL && cmd->has_transform) {
+			pixman_image_set_transform(ctx->srcs[i], &cmd->transform);
+		}
+	}
+	return ctx->srcs[i];
+}
+
+static pixman_image_t *get_command_mask(struct pixman_job_context *ctx,
+		const struct wlr_pixman_command *cmd, size_t i) {
+	if (cmd->mask_alpha == 0xFFFF) {
+		return NULL;
+	}
+	if (ctx->masks[i] == NULL) {
+		struct pixman_color mask_colour = { .alpha = cmd->mask_alpha };
+		ctx->masks[i] = pixman_image_create_solid_fill(&mask_colour);
+	}
+	return ctx->masks[i];
+}
+
+static void run_tile(struct pixman_job *job, struct pixman_job_context *ctx,
+		const struct wlr_box *tile) {
+	for (size_t i = 0; i < job->commands_len; i++) {
+		const struct wlr_pixman_command *cmd = &job->commands[i];
+
+		struct wlr_box box;
+		if (!wlr_box_intersection(&box, &cmd->box, tile)) {
+			continue;
+		}
+
+		if (cmd->src_bits == NULL) {
+			pixman_box32_t rect = {
+				.x1 = box.x,
+				.y1 = box.y,
+				.x2 = box.x + box.width,
+				.y2 = box.y + box.height,
+			};
+			pixman_image_fill_boxes(cmd->op, ctx->dest, &cmd->color, 1, &rect);
+			continue;
+		}
+
+		pixman_image_t *src = get_command_src(ctx, cmd, i);
+		if (src == NULL) {
+			continue;
+		}
+		pixman_image_composite32(cmd->op, src, get_command_mask(ctx, cmd, i),
+			ctx->dest, box.x + cmd->src_x, box.y + cmd->src_y, 0, 0,
+			box.x, box.y, box.width, box.height);
+	}
+}
+
+static void run_job(struct pixman_job *job) {
+	struct pixman_job_context ctx = {0};
+	ctx.dest = pixman_image_create_bits_no_clear(job->format,
+		job->width, job->height, job->bits, job->stride);
+	ctx.srcs = calloc(job->commands_len, sizeof(ctx.srcs[0]));
+	ctx.masks = calloc(job->commands_len, sizeof(ctx.masks[0]));
+	if (ctx.dest == NULL || ctx.srcs == NULL || ctx.masks == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		// Other threads still pick up the remaining tiles
+		goto out;
+	}
+
+	int tiles_len = job->tiles_x * job->tiles_y;
+	while (true) {
+		int i = atomic_fetch_add(&job->next_tile, 1);
+		if (i >= tiles_len) {
+			break;
+		}
+
+		struct wlr_box tile = {
+			.x = job->area.x + (i % job->tiles_x) * TILE_SIZE,
+			.y = job->area.y + (i / job->tiles_x) * TILE_SIZE,
+			.width = TILE_SIZE,
+			.height = TILE_SIZE,
+		};
+		wlr_box_intersection(&tile, &tile, &job->area);
+		run_tile(job, &ctx, &tile);
+	}
+
+out:
+	for (size_t i = 0; i < job->commands_len; i++) {
+		if (ctx.srcs != NULL && ctx.srcs[i] != NULL) {
+			pixman_image_unref(ctx.srcs[i]);
+		}
+		if (ctx.masks != NULL && ctx.masks[i] != NULL) {
+			pixman_image_unref(ctx.masks[i]);
+		}
+	}
+	free(ctx.srcs);
+	free(ctx.masks);
+	if (ctx.dest != NULL) {
+		pixman_image_unref(ctx.dest);
+	}
+}
+
+static void *worker_main(void *data) {
+	struct wlr_pixman_workers *workers = data;
+
+	uint64_t job_seq = 0;
+	pthread_mutex_lock(&workers->lock);
+	while (true) {
+		while (!workers->stop && workers->job_seq == job_seq) {
+			pthread_cond_wait(&workers->job_cond, &workers->lock);
+		}
+		if (workers->stop) {
+			break;
+		}
+		job_seq = workers->job_seq;
+		struct pixman_job *job = workers->job;
+		pthread_mutex_unlock(&workers->lock);
+
+		run_job(job);
+
+		pthread_mutex_lock(&workers->lock);
+		workers->running--;
+		if (workers->running == 0) {
+			pthread_cond_signal(&workers->done_cond);
+		}
+	}
+	pthread_mutex_unlock(&workers->lock);
+
+	return NULL;
+}
+
+struct wlr_pixman_workers *pixman_workers_create(size_t threads_len) {
+	struct wlr_pixman_workers *workers = calloc(1, sizeof(*workers));
+	if (workers == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	workers->threads = calloc(threads_len, sizeof(workers->threads[0]));
+	if (workers->threads == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		free(workers);
+		return NULL;
+	}
+
+	pthread_mutex_init(&workers->lock, NULL);
+	pthread_cond_init(&workers->job_cond, NULL);
+	pthread_cond_init(&workers->done_cond, NULL);
+
+	// Signals are handled by the compositor's event loop, make sure they're
+	// never delivered to the worker threads
+	sigset_t set, old_set;
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old_set);
+
+	for (size_t i = 0; i < threads_len; i++) {
+		int ret = pthread_create(&workers->threads[i], NULL,
+			worker_main, workers);
+		if (ret != 0) {
+			wlr_log(WLR_ERROR, "pthread_create failed: %d", ret);
+			break;
+		}
+		workers->threads_len++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+	if (workers->threads_len == 0) {
+		pixman_workers_destroy(workers);
+		return NULL;
+	}
+
+	return workers;
+}
+
+void pixman_workers_destroy(struct wlr_pixman_workers *workers) {
+	if (workers == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&workers->lock);
+	workers->stop = true;
+	pthread_cond_broadcast(&workers->job_cond);
+	pthread_mutex_unlock(&workers->lock);
+
+	for (size_t i = 0; i < workers->threads_len; i++) {
+		pthread_join(workers->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&workers->done_cond);
+	pthread_cond_destroy(&workers->job_cond);
+	pthread_mutex_destroy(&workers->lock);
+	free(workers->threads);
+	free(workers);
+}
+
+void pixman_workers_run(struct wlr_pixman_workers *workers,
+		pixman_image_t *dest, const struct wlr_pixman_command *commands,
+		size_t commands_len) {
+	struct pixman_job job = {
+		.commands = commands,
+		.commands_len = commands_len,
+		.format = pixman_image_get_format(dest),
+		.bits = pixman_image_get_data(dest),
+		.width = pixman_image_get_width(dest),
+		.height = pixman_image_get_height(dest),
+		.stride = pixman_image_get_stride(dest),
+	};
+
+	// Only split the area touched by the commands into tiles
+	pixman_region32_t area;
+	pixman_region32_init(&area);
+	for (size_t i = 0; i < commands_len; i++) {
+		const struct wlr_box *box = &commands[i].box;
+		pixman_region32_union_rect(&area, &area,
+			box->x, box->y, box->width, box->height);
+	}
+	const pixman_box32_t *extents = pixman_region32_extents(&area);
+	job.area = (struct wlr_box){
+		.x = extents->x1,
+		.y = extents->y1,
+		.width = extents->x2 - extents->x1,
+		.height = extents->y2 - extents->y1,
+	};
+	pixman_region32_fini(&area);
+	if (wlr_box_empty(&job.area)) {
+		return;
+	}
+
+	job.tiles_x = (job.area.width + TILE_SIZE - 1) / TILE_SIZE;
+	job.tiles_y = (job.area.height + TILE_SIZE - 1) / TILE_SIZE;
+	atomic_init(&job.next_tile, 0);
+
+	pthread_mutex_lock(&workers->lock);
+	assert(workers->running == 0);
+	workers->job = &job;
+	workers->job_seq++;
+	workers->running = workers->threads_len;
+	pthread_cond_broadcast(&workers->job_cond);
+	pthread_mutex_unlock(&workers->lock);
+
+	// The calling thread takes its share of the tiles too
+	run_job(&job);
+
+	pthread_mutex_lock(&workers->lock);
+	while (workers->running > 0) {
+		pthread_cond_wait(&workers->done_cond, &workers->lock);
+	}
+	workers->job = NULL;
+	pthread_mutex_unlock(&workers->lock);
+}
@@ -1,10 +1,13 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <stdlib.h>
+#include <time.h>
 #include <wlr/util/log.h>
 #include <wlr/types/wlr_buffer.h>
 #include "render/allocator/allocator.h"
 #include "render/drm_format_set.h"
 #include "render/swapchain.h"
+#include "util/time.h"
 
 static void swapchain_handle_allocator_destroy(struct wl_listener *listener,
 		void *data) {
@@ -21,6 +24,7 @@ struct wlr_swapchain *wlr_swapchain_create(
 		return NULL;
 	}
 	swapchain->allocator = alloc;
+	swapchain->capacity = WLR_SWAPCHAIN_CAP;
 	swapchain->width = width;
 	swapchain->height = height;
 
@@ -56,6 +60,36 @@ void wlr_swapchain_destroy(struct wlr_swapchain *swapchain) {
 	free(swapchain);
 }
 
+static int64_t get_time_msec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_msec(&now);
+}
+
+void wlr_swapchain_trim(struct wlr_swapchain *swapchain) {
+	int64_t now = get_time_msec();
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
+		if (slot->buffer == NULL || slot->acquired) {
+			continue;
+		}
+		if (i < swapchain->capacity &&
+				now - slot->last_used < WLR_SWAPCHAIN_IDLE_MS) {
+			continue;
+		}
+		wlr_log(WLR_DEBUG, "Releasing idle swapchain buffer");
+		slot_reset(slot);
+		swapchain->stats.trims++;
+	}
+}
+
+void wlr_swapchain_set_capacity(struct wlr_swapchain *swapchain,
+		size_t capacity) {
+	assert(capacity > 0 && capacity <= WLR_SWAPCHAIN_CAP);
+	swapchain->capacity = capacity;
+	wlr_swapchain_trim(swapchain);
+}
+
 static void slot_handle_release(struct wl_listener *listener, void *data) {
 	struct wlr_swapchain_slot *slot =
 		wl_container_of(listener, slot, release);
@@ -69,6 +103,7 @@ static struct wlr_buffer *slot_acquire(struct wlr_swapchain *swapchain,
 	assert(slot->buffer != NULL);
 
 	slot->acquired = true;
+	slot->last_used = get_time_msec();
 
 	slot->release.notify = slot_handle_release;
 	wl_signal_add(&slot->buffer->events.release, &slot->release);
@@ -83,18 +118,20 @@ static struct wlr_buffer *slot_acquire(struct wlr_swapchain *swapchain,
 struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
 		int *age) {
 	struct wlr_swapchain_slot *free_slot = NULL;
-	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+	for (size_t i = 0; i < swapchain->capacity; i++) {
 		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
 		if (slot->acquired) {
 			continue;
 		}
 		if (slot->buffer != NULL) {
+			swapchain->stats.reuses++;
 			return slot_acquire(swapchain, slot, age);
 		}
 		free_slot = slot;
 	}
 	if (free_slot == NULL) {
 		wlr_log(WLR_ERROR, "No free output buffer slot");
+		swapchain->stats.starvations++;
 		return NULL;
 	}
 
@@ -109,6 +146,7 @@ struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
 		wlr_log(WLR_ERROR, "Failed to allocate buffer");
 		return NULL;
 	}
+	swapchain->stats.allocations++;
 	return slot_acquire(swapchain, free_slot, age);
 }
 
@@ -141,4 +179,6 @@ void wlr_swapchain_set_buffer_submitted(struct wlr_swapchain *swapchain,
 			slot->age++;
 		}
 	}
+
+	wlr_swapchain_trim(swapchain);
 }
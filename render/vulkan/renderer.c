@@ -19,6 +19,7 @@
 
 #include "render/pixel_format.h"
 #include "render/vulkan.h"
+#include "render/wlr_renderer.h"
 #include "render/vulkan/shaders/common.vert.h"
 #include "render/vulkan/shaders/texture.frag.h"
 #include "render/vulkan/shaders/quad.frag.h"
@@ -36,7 +37,10 @@
 
 static const VkDeviceSize min_stage_size = 1024 * 1024; // 1MB
 static const VkDeviceSize max_stage_size = 64 * min_stage_size; // 64MB
+// number of frames after which an unused staging buffer is destroyed
+static const uint32_t max_stage_idle_frames = 256;
 static const size_t start_descriptor_pool_size = 256u;
+static const size_t max_descriptor_pool_size = 4096u;
 static bool default_debug = true;
 
 static const struct wlr_renderer_impl renderer_impl;
@@ -103,9 +107,13 @@ struct wlr_vk_descriptor_pool *vulkan_alloc_texture_ds(
 			return NULL;
 		}
 
-		size_t count = renderer->last_pool_size;
-		if (!count) {
+		// Grow the pools geometrically, so that compositors with many
+		// textures don't end up walking a long list of full pools
+		size_t count = 2 * renderer->last_pool_size;
+		if (count < start_descriptor_pool_size) {
 			count = start_descriptor_pool_size;
+		} else if (count > max_descriptor_pool_size) {
+			count = max_descriptor_pool_size;
 		}
 
 		pool->free = count;
@@ -129,6 +137,7 @@ struct wlr_vk_descriptor_pool *vulkan_alloc_texture_ds(
 		}
 
 		wl_list_insert(&renderer->descriptor_pools, &pool->link);
+		renderer->last_pool_size = count;
 	}
 
 	ds_info.descriptorPool = pool->pool;
@@ -183,10 +192,19 @@ static void shared_buffer_destroy(struct wlr_vk_renderer *r,
 	free(buffer);
 }
 
+// Must only be called once the stage command buffer has finished execution
 static void release_stage_allocations(struct wlr_vk_renderer *renderer) {
-	struct wlr_vk_shared_buffer *buf;
-	wl_list_for_each(buf, &renderer->stage.buffers, link) {
+	struct wlr_vk_shared_buffer *buf, *tmp_buf;
+	wl_list_for_each_safe(buf, tmp_buf, &renderer->stage.buffers, link) {
 		buf->allocs_size = 0u;
+
+		// Staging buffers are sized for upload peaks (e.g. a burst of
+		// new windows), don't keep that memory around forever
+		if (renderer->frame - buf->last_used > max_stage_idle_frames) {
+			wlr_log(WLR_DEBUG, "Destroying idle vk staging buffer of "
+				"size %" PRIu64, buf->buf_size);
+			shared_buffer_destroy(renderer, buf);
+		}
 	}
 }
 
@@ -224,6 +242,7 @@ struct wlr_vk_buffer_span vulkan_get_stage_span(struct wlr_vk_renderer *r,
 		struct wlr_vk_allocation *a = &buf->allocs[buf->allocs_size - 1];
 		a->start = start;
 		a->size = size;
+		buf->last_used = r->frame;
 		return (struct wlr_vk_buffer_span) {
 			.buffer = buf,
 			.alloc = *a,
@@ -300,6 +319,7 @@ struct wlr_vk_buffer_span vulkan_get_stage_span(struct wlr_vk_renderer *r,
 	wl_list_insert(&r->stage.buffers, &buf->link);
 
 	buf->allocs_capacity = start_count;
+	buf->last_used = r->frame;
 	buf->allocs_size = 1u;
 	buf->allocs[0].start = 0u;
 	buf->allocs[0].size = size;
@@ -552,6 +572,7 @@ static void vulkan_begin(struct wlr_renderer *wlr_renderer,
 	VkCommandBuffer cb = renderer->cb;
 	VkCommandBufferBeginInfo begin_info = {0};
 	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	vkBeginCommandBuffer(cb, &begin_info);
 
 	// begin render pass
@@ -581,6 +602,54 @@ static void vulkan_begin(struct wlr_renderer *wlr_renderer,
 	renderer->render_width = width;
 	renderer->render_height = height;
 	renderer->bound_pipe = VK_NULL_HANDLE;
+	renderer->bound_ds = VK_NULL_HANDLE;
+	renderer->frag_pcr_size = 0;
+}
+
+static bool vulkan_begin_timing(struct wlr_renderer *wlr_renderer) {
+	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
+	if (renderer->timestamp_pool == VK_NULL_HANDLE) {
+		return false;
+	}
+	renderer->timestamps_written = false;
+
+	// Queries can't be reset inside a render pass, the stage command buffer
+	// is executed before the render one
+	VkCommandBuffer stage_cb = vulkan_record_stage_cb(renderer);
+	vkCmdResetQueryPool(stage_cb, renderer->timestamp_pool, 0, 2);
+
+	vkCmdWriteTimestamp(renderer->cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		renderer->timestamp_pool, 0);
+	return true;
+}
+
+static void vulkan_end_timing(struct wlr_renderer *wlr_renderer) {
+	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
+	vkCmdWriteTimestamp(renderer->cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		renderer->timestamp_pool, 1);
+	renderer->timestamps_written = true;
+}
+
+// Must be called once the frame's commands have finished execution
+static void emit_timing(struct wlr_vk_renderer *renderer) {
+	renderer->timestamps_written = false;
+
+	uint64_t timestamps[2];
+	VkResult res = vkGetQueryPoolResults(renderer->dev->dev,
+		renderer->timestamp_pool, 0, 2, sizeof(timestamps), timestamps,
+		sizeof(timestamps[0]), VK_QUERY_RESULT_64_BIT);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkGetQueryPoolResults", res);
+		return;
+	}
+
+	uint32_t bits = renderer->dev->timestamp_valid_bits;
+	uint64_t mask = bits >= 64 ? UINT64_MAX : (UINT64_C(1) << bits) - 1;
+	double period = renderer->dev->timestamp_period;
+	wlr_renderer_emit_timing(&renderer->wlr_renderer,
+		renderer->wlr_renderer.render_seq,
+		(uint64_t)((timestamps[0] & mask) * period),
+		(uint64_t)((timestamps[1] & mask) * period));
 }
 
 static void vulkan_end(struct wlr_renderer *wlr_renderer) {
@@ -593,6 +662,8 @@ static void vulkan_end(struct wlr_renderer *wlr_renderer) {
 	renderer->render_width = 0u;
 	renderer->render_height = 0u;
 	renderer->bound_pipe = VK_NULL_HANDLE;
+	renderer->bound_ds = VK_NULL_HANDLE;
+	renderer->frag_pcr_size = 0;
 
 	vkCmdEndRenderPass(render_cb);
 
@@ -735,6 +806,10 @@ static void vulkan_end(struct wlr_renderer *wlr_renderer) {
 	++renderer->frame;
 	release_stage_allocations(renderer);
 
+	if (renderer->timestamps_written) {
+		emit_timing(renderer);
+	}
+
 	// destroy pending textures
 	wl_list_for_each_safe(texture, tmp_tex, &renderer->destroy_textures, destroy_link) {
 		wlr_texture_destroy(&texture->wlr_texture);
@@ -748,10 +823,26 @@ static void vulkan_end(struct wlr_renderer *wlr_renderer) {
 	}
 }
 
-static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_renderer,
+// Push the fragment shader constants, unless they're already set. Both
+// pipelines share the same layout, so push constants stay valid across
+// pipeline binds.
+static void push_frag_pcr(struct wlr_vk_renderer *renderer,
+		const float *data, uint32_t size) {
+	if (renderer->frag_pcr_size == size &&
+			memcmp(renderer->frag_pcr, data, size) == 0) {
+		return;
+	}
+
+	vkCmdPushConstants(renderer->cb, renderer->pipe_layout,
+		VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(struct vert_pcr_data), size,
+		data);
+	memcpy(renderer->frag_pcr, data, size);
+	renderer->frag_pcr_size = size;
+}
+
+static void bind_texture_draw(struct wlr_vk_renderer *renderer,
 		struct wlr_texture *wlr_texture, const struct wlr_fbox *box,
 		const float matrix[static 9], float alpha) {
-	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
 	VkCommandBuffer cb = renderer->cb;
 
 	struct wlr_vk_texture *texture = vulkan_get_texture(wlr_texture);
@@ -775,8 +866,11 @@ static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_render
 		renderer->bound_pipe = pipe;
 	}
 
-	vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
-		renderer->pipe_layout, 0, 1, &texture->ds, 0, NULL);
+	if (texture->ds != renderer->bound_ds) {
+		vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+			renderer->pipe_layout, 0, 1, &texture->ds, 0, NULL);
+		renderer->bound_ds = texture->ds;
+	}
 
 	float final_matrix[9];
 	wlr_matrix_multiply(final_matrix, renderer->projection, matrix);
@@ -796,11 +890,17 @@ static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_render
 
 	vkCmdPushConstants(cb, renderer->pipe_layout,
 		VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(vert_pcr_data), &vert_pcr_data);
-	vkCmdPushConstants(cb, renderer->pipe_layout,
-		VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(vert_pcr_data), sizeof(float),
-		&alpha);
-	vkCmdDraw(cb, 4, 1, 0, 0);
+	push_frag_pcr(renderer, &alpha, sizeof(float));
 	texture->last_used = renderer->frame;
+}
+
+static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_renderer,
+		struct wlr_texture *wlr_texture, const struct wlr_fbox *box,
+		const float matrix[static 9], float alpha) {
+	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
+
+	bind_texture_draw(renderer, wlr_texture, box, matrix, alpha);
+	vkCmdDraw(renderer->cb, 4, 1, 0, 0);
 
 	return true;
 }
@@ -855,9 +955,8 @@ static const uint32_t *vulkan_get_shm_texture_formats(
 	return renderer->dev->shm_formats;
 }
 
-static void vulkan_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+static void bind_quad_draw(struct wlr_vk_renderer *renderer,
 		const float color[static 4], const float matrix[static 9]) {
-	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
 	VkCommandBuffer cb = renderer->cb;
 
 	VkPipeline pipe = renderer->current_render_buffer->render_setup->quad_pipe;
@@ -891,10 +990,63 @@ static void vulkan_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 
 	vkCmdPushConstants(cb, renderer->pipe_layout,
 		VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(vert_pcr_data), &vert_pcr_data);
-	vkCmdPushConstants(cb, renderer->pipe_layout,
-		VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(vert_pcr_data), sizeof(float) * 4,
-		linear_color);
-	vkCmdDraw(cb, 4, 1, 0, 0);
+	push_frag_pcr(renderer, linear_color, sizeof(linear_color));
+}
+
+static void vulkan_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
+
+	bind_quad_draw(renderer, color, matrix);
+	vkCmdDraw(renderer->cb, 4, 1, 0, 0);
+}
+
+static void draw_clipped(struct wlr_vk_renderer *renderer,
+		const struct wlr_render_quad *quads, size_t quads_len) {
+	struct wlr_box target = {
+		.width = renderer->render_width,
+		.height = renderer->render_height,
+	};
+
+	for (size_t i = 0; i < quads_len; i++) {
+		struct wlr_box clip;
+		if (!wlr_box_intersection(&clip, &quads[i].clip, &target)) {
+			continue;
+		}
+		VkRect2D rect = {{clip.x, clip.y}, {clip.width, clip.height}};
+		vkCmdSetScissor(renderer->cb, 0, 1, &rect);
+		vkCmdDraw(renderer->cb, 4, 1, 0, 0);
+	}
+}
+
+static bool vulkan_render_quads(struct wlr_renderer *wlr_renderer,
+		const struct wlr_render_quad *quads, size_t quads_len) {
+	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
+
+	// Descriptor sets and push constants are only recorded once for each run
+	// of quads sharing their state, only the scissor changes between draws
+	size_t i = 0;
+	while (i < quads_len) {
+		const struct wlr_render_quad *quad = &quads[i];
+		size_t run_len = 1;
+		while (i + run_len < quads_len &&
+				render_quads_share_state(quad, &quads[i + run_len])) {
+			run_len++;
+		}
+
+		if (quad->texture != NULL) {
+			bind_texture_draw(renderer, quad->texture, &quad->src_box,
+				quad->matrix, quad->alpha);
+		} else {
+			bind_quad_draw(renderer, quad->color, quad->matrix);
+		}
+		draw_clipped(renderer, quad, run_len);
+
+		i += run_len;
+	}
+
+	vulkan_scissor(wlr_renderer, NULL);
+	return true;
 }
 
 static const struct wlr_drm_format_set *vulkan_get_dmabuf_texture_formats(
@@ -960,6 +1112,7 @@ static void vulkan_destroy(struct wlr_renderer *wlr_renderer) {
 	vkDestroyShaderModule(dev->dev, renderer->quad_frag_module, NULL);
 
 	vkDestroyFence(dev->dev, renderer->fence, NULL);
+	vkDestroyQueryPool(dev->dev, renderer->timestamp_pool, NULL);
 	vkDestroyPipelineLayout(dev->dev, renderer->pipe_layout, NULL);
 	vkDestroyDescriptorSetLayout(dev->dev, renderer->ds_layout, NULL);
 	vkDestroySampler(dev->dev, renderer->sampler, NULL);
@@ -997,6 +1150,9 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.scissor = vulkan_scissor,
 	.render_subtexture_with_matrix = vulkan_render_subtexture_with_matrix,
 	.render_quad_with_matrix = vulkan_render_quad_with_matrix,
+	.render_quads = vulkan_render_quads,
+	.begin_timing = vulkan_begin_timing,
+	.end_timing = vulkan_end_timing,
 	.get_shm_texture_formats = vulkan_get_shm_texture_formats,
 	.get_dmabuf_texture_formats = vulkan_get_dmabuf_texture_formats,
 	.get_render_formats = vulkan_get_render_formats,
@@ -1462,6 +1618,20 @@ struct wlr_renderer *vulkan_renderer_create_for_device(struct wlr_vk_device *dev
 		goto error;
 	}
 
+	if (dev->timestamp_valid_bits > 0) {
+		VkQueryPoolCreateInfo query_pool_info = {0};
+		query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		query_pool_info.queryCount = 2;
+		res = vkCreateQueryPool(dev->dev, &query_pool_info, NULL,
+			&renderer->timestamp_pool);
+		if (res != VK_SUCCESS) {
+			// Not fatal, frames just won't be timed on the GPU
+			wlr_vk_error("vkCreateQueryPool", res);
+			renderer->timestamp_pool = VK_NULL_HANDLE;
+		}
+	}
+
 	// staging command buffer
 	VkCommandBufferAllocateInfo cmd_buf_info = {0};
 	cmd_buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
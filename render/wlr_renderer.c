@@ -1,6 +1,8 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <wlr/render/interface.h>
 #include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
@@ -37,6 +39,24 @@ void wlr_renderer_init(struct wlr_renderer *renderer,
 	renderer->impl = impl;
 
 	wl_signal_init(&renderer->events.destroy);
+	wl_signal_init(&renderer->events.timing);
+}
+
+static uint64_t get_current_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void wlr_renderer_emit_timing(struct wlr_renderer *r, uint64_t render_seq,
+		uint64_t begin_ns, uint64_t end_ns) {
+	struct wlr_renderer_timing_event event = {
+		.renderer = r,
+		.render_seq = render_seq,
+		.begin_ns = begin_ns,
+		.end_ns = end_ns,
+	};
+	wlr_signal_emit_safe(&r->events.timing, &event);
 }
 
 void wlr_renderer_destroy(struct wlr_renderer *r) {
@@ -63,14 +83,30 @@ bool renderer_bind_buffer(struct wlr_renderer *r, struct wlr_buffer *buffer) {
 	return r->impl->bind_buffer(r, buffer);
 }
 
-void wlr_renderer_begin(struct wlr_renderer *r, uint32_t width, uint32_t height) {
+static void renderer_begin(struct wlr_renderer *r, uint32_t width,
+		uint32_t height, bool internal) {
 	assert(!r->rendering);
 
+	if (!internal) {
+		r->render_seq++;
+	}
+	r->timing = !internal && !wl_list_empty(&r->events.timing.listener_list);
+	if (r->timing) {
+		r->timing_begin_ns = get_current_time_nsec();
+	}
+
 	r->impl->begin(r, width, height);
 
+	r->timing_by_impl = r->timing && r->impl->begin_timing != NULL &&
+		r->impl->begin_timing(r);
+
 	r->rendering = true;
 }
 
+void wlr_renderer_begin(struct wlr_renderer *r, uint32_t width, uint32_t height) {
+	renderer_begin(r, width, height, false);
+}
+
 bool wlr_renderer_begin_with_buffer(struct wlr_renderer *r,
 		struct wlr_buffer *buffer) {
 	if (!renderer_bind_buffer(r, buffer)) {
@@ -81,15 +117,35 @@ bool wlr_renderer_begin_with_buffer(struct wlr_renderer *r,
 	return true;
 }
 
+bool renderer_begin_internal_with_buffer(struct wlr_renderer *r,
+		struct wlr_buffer *buffer) {
+	if (!renderer_bind_buffer(r, buffer)) {
+		return false;
+	}
+	renderer_begin(r, buffer->width, buffer->height, true);
+	r->rendering_with_buffer = true;
+	return true;
+}
+
 void wlr_renderer_end(struct wlr_renderer *r) {
 	assert(r->rendering);
 
+	if (r->timing_by_impl) {
+		r->impl->end_timing(r);
+	}
+
 	if (r->impl->end) {
 		r->impl->end(r);
 	}
 
 	r->rendering = false;
 
+	if (r->timing && !r->timing_by_impl) {
+		wlr_renderer_emit_timing(r, r->render_seq, r->timing_begin_ns,
+			get_current_time_nsec());
+	}
+	r->timing = r->timing_by_impl = false;
+
 	if (r->rendering_with_buffer) {
 		renderer_bind_buffer(r, NULL);
 		r->rendering_with_buffer = false;
@@ -161,6 +217,48 @@ void wlr_render_quad_with_matrix(struct wlr_renderer *r,
 	r->impl->render_quad_with_matrix(r, color, matrix);
 }
 
+bool render_quads_share_state(const struct wlr_render_quad *a,
+		const struct wlr_render_quad *b) {
+	if (a->texture != b->texture ||
+			memcmp(a->matrix, b->matrix, sizeof(a->matrix)) != 0) {
+		return false;
+	}
+	if (a->texture == NULL) {
+		return memcmp(a->color, b->color, sizeof(a->color)) == 0;
+	}
+	return a->alpha == b->alpha && a->src_box.x == b->src_box.x &&
+		a->src_box.y == b->src_box.y && a->src_box.width == b->src_box.width &&
+		a->src_box.height == b->src_box.height;
+}
+
+bool wlr_render_quads(struct wlr_renderer *r,
+		const struct wlr_render_quad *quads, size_t quads_len) {
+	assert(r->rendering);
+	if (r->impl->render_quads) {
+		return r->impl->render_quads(r, quads, quads_len);
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < quads_len; i++) {
+		const struct wlr_render_quad *quad = &quads[i];
+		if (wlr_box_empty(&quad->clip)) {
+			continue;
+		}
+
+		struct wlr_box clip = quad->clip;
+		r->impl->scissor(r, &clip);
+		if (quad->texture != NULL) {
+			ok = r->impl->render_subtexture_with_matrix(r, quad->texture,
+				&quad->src_box, quad->matrix, quad->alpha) && ok;
+		} else {
+			r->impl->render_quad_with_matrix(r, quad->color, quad->matrix);
+		}
+	}
+	r->impl->scissor(r, NULL);
+
+	return ok;
+}
+
 const uint32_t *wlr_renderer_get_shm_texture_formats(struct wlr_renderer *r,
 		size_t *len) {
 	return r->impl->get_shm_texture_formats(r, len);
@@ -308,3 +406,11 @@ int wlr_renderer_get_drm_fd(struct wlr_renderer *r) {
 	}
 	return r->impl->get_drm_fd(r);
 }
+
+int wlr_renderer_export_sync_file(struct wlr_renderer *r) {
+	assert(!r->rendering);
+	if (!r->impl->export_sync_file) {
+		return -1;
+	}
+	return r->impl->export_sync_file(r);
+}
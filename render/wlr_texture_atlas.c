@@ -0,0 +1,343 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/render/wlr_texture_atlas.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/util/addon.h>
+#include <wlr/util/log.h>
+#include "render/pixel_format.h"
+
+#define ATLAS_PAGE_SIZE 1024
+#define ATLAS_MAX_ENTRY_SIZE 256
+// Texels around each entry, filled with copies of the entry's edges. Linear
+// filtering at the edges of an entry then behaves as if the entry had its own
+// texture with GL_CLAMP_TO_EDGE, instead of picking up the neighbouring
+// entries or transparent texels.
+#define ATLAS_GUTTER 1
+
+/**
+ * Pages are filled with shelves: rows of entries of similar heights. Shelves
+ * are allocated from top to bottom, entries within a shelf from left to
+ * right. Space isn't reused until all entries of the page are gone.
+ */
+struct atlas_shelf {
+	int y, height;
+	int width; // used so far
+};
+
+struct atlas_page {
+	struct wlr_texture_atlas *atlas;
+	struct wl_list link; // wlr_texture_atlas.pages
+
+	uint32_t format;
+	struct wlr_texture *texture;
+
+	struct wl_array shelves; // struct atlas_shelf
+	int shelves_height;
+
+	struct wl_list entries; // atlas_entry.link
+};
+
+struct atlas_entry {
+	struct atlas_page *page;
+	struct wl_list link; // atlas_page.entries
+	struct wlr_addon addon; // on the buffer, owned by the atlas
+
+	struct wlr_box box;
+};
+
+struct wlr_texture_atlas *wlr_texture_atlas_create(
+		struct wlr_renderer *renderer) {
+	struct wlr_texture_atlas *atlas = calloc(1, sizeof(*atlas));
+	if (atlas == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+	atlas->renderer = renderer;
+	wl_list_init(&atlas->pages);
+	return atlas;
+}
+
+static void page_destroy(struct atlas_page *page) {
+	assert(wl_list_empty(&page->entries));
+	wl_list_remove(&page->link);
+	wl_array_release(&page->shelves);
+	wlr_texture_destroy(page->texture);
+	free(page);
+}
+
+static void entry_destroy(struct atlas_entry *entry) {
+	struct atlas_page *page = entry->page;
+	wl_list_remove(&entry->link);
+	free(entry);
+
+	if (wl_list_empty(&page->entries)) {
+		page_destroy(page);
+	}
+}
+
+static void entry_handle_addon_destroy(struct wlr_addon *addon) {
+	struct atlas_entry *entry = wl_container_of(addon, entry, addon);
+	wlr_addon_finish(&entry->addon);
+	entry_destroy(entry);
+}
+
+static const struct wlr_addon_interface entry_addon_impl = {
+	.name = "wlr_texture_atlas_entry",
+	.destroy = entry_handle_addon_destroy,
+};
+
+void wlr_texture_atlas_destroy(struct wlr_texture_atlas *atlas) {
+	if (atlas == NULL) {
+		return;
+	}
+
+	struct atlas_page *page, *page_tmp;
+	wl_list_for_each_safe(page, page_tmp, &atlas->pages, link) {
+		struct atlas_entry *entry, *entry_tmp;
+		wl_list_for_each_safe(entry, entry_tmp, &page->entries, link) {
+			wlr_addon_finish(&entry->addon);
+			wl_list_remove(&entry->link);
+			free(entry);
+		}
+		page_destroy(page);
+	}
+
+	free(atlas);
+}
+
+static bool renderer_supports_format(struct wlr_renderer *renderer,
+		uint32_t format) {
+	size_t len = 0;
+	const uint32_t *formats =
+		wlr_renderer_get_shm_texture_formats(renderer, &len);
+	for (size_t i = 0; i < len; i++) {
+		if (formats[i] == format) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static struct atlas_page *page_create(struct wlr_texture_atlas *atlas,
+		uint32_t format) {
+	const struct wlr_pixel_format_info *info =
+		drm_get_pixel_format_info(format);
+	if (info == NULL || info->bpp % 8 != 0 ||
+			!renderer_supports_format(atlas->renderer, format)) {
+		return NULL;
+	}
+
+	struct atlas_page *page = calloc(1, sizeof(*page));
+	if (page == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	// Start from transparent pixels, the space between shelves and entries
+	// isn't written to
+	uint32_t stride = ATLAS_PAGE_SIZE * info->bpp / 8;
+	void *data = calloc(ATLAS_PAGE_SIZE, stride);
+	if (data == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		free(page);
+		return NULL;
+	}
+	page->texture = wlr_texture_from_pixels(atlas->renderer, format, stride,
+		ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, data);
+	free(data);
+	if (page->texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create texture atlas page");
+		free(page);
+		return NULL;
+	}
+
+	page->atlas = atlas;
+	page->format = format;
+	wl_array_init(&page->shelves);
+	wl_list_init(&page->entries);
+	wl_list_insert(&atlas->pages, &page->link);
+	return page;
+}
+
+static bool page_alloc(struct atlas_page *page, int width, int height,
+		struct wlr_box *box) {
+	int padded_width = width + 2 * ATLAS_GUTTER;
+	int padded_height = height + 2 * ATLAS_GUTTER;
+
+	// Pick the lowest shelf with enough room left, and don't waste more
+	// than half of a shelf's height on a single entry
+	struct atlas_shelf *best = NULL, *shelf;
+	wl_array_for_each(shelf, &page->shelves) {
+		if (shelf->height < padded_height ||
+				shelf->height > 2 * padded_height ||
+				shelf->width + padded_width > ATLAS_PAGE_SIZE) {
+			continue;
+		}
+		if (best == NULL || shelf->height < best->height) {
+			best = shelf;
+		}
+	}
+
+	if (best == NULL) {
+		if (page->shelves_height + padded_height > ATLAS_PAGE_SIZE) {
+			return false;
+		}
+		best = wl_array_add(&page->shelves, sizeof(*best));
+		if (best == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return false;
+		}
+		*best = (struct atlas_shelf){
+			.y = page->shelves_height,
+			.height = padded_height,
+		};
+		page->shelves_height += padded_height;
+	}
+
+	*box = (struct wlr_box){
+		.x = best->width + ATLAS_GUTTER,
+		.y = best->y + ATLAS_GUTTER,
+		.width = width,
+		.height = height,
+	};
+	best->width += padded_width;
+	return true;
+}
+
+static bool write_region(struct wlr_texture *texture, uint32_t stride,
+		int src_x, int src_y, int dst_x, int dst_y, int width, int height,
+		const void *data) {
+	return wlr_texture_write_pixels(texture, stride, width, height,
+		src_x, src_y, dst_x, dst_y, data);
+}
+
+/**
+ * Upload the buffer's contents to the entry, then replicate its edge rows and
+ * columns (and corner texels) into the gutter.
+ */
+static bool entry_write_pixels(struct atlas_entry *entry, uint32_t stride,
+		const void *data) {
+	struct wlr_texture *texture = entry->page->texture;
+	const struct wlr_box *box = &entry->box;
+	int w = box->width, h = box->height;
+
+	if (!write_region(texture, stride, 0, 0, box->x, box->y, w, h, data)) {
+		return false;
+	}
+
+	for (int i = 1; i <= ATLAS_GUTTER; i++) {
+		int left = box->x - i, right = box->x + w - 1 + i;
+		int top = box->y - i, bottom = box->y + h - 1 + i;
+		bool ok =
+			write_region(texture, stride, 0, 0, box->x, top, w, 1, data) &&
+			write_region(texture, stride, 0, h - 1, box->x, bottom, w, 1, data) &&
+			write_region(texture, stride, 0, 0, left, box->y, 1, h, data) &&
+			write_region(texture, stride, w - 1, 0, right, box->y, 1, h, data);
+		for (int j = 1; ok && j <= ATLAS_GUTTER; j++) {
+			int corner_top = box->y - j, corner_bottom = box->y + h - 1 + j;
+			ok = write_region(texture, stride, 0, 0,
+					left, corner_top, 1, 1, data) &&
+				write_region(texture, stride, w - 1, 0,
+					right, corner_top, 1, 1, data) &&
+				write_region(texture, stride, 0, h - 1,
+					left, corner_bottom, 1, 1, data) &&
+				write_region(texture, stride, w - 1, h - 1,
+					right, corner_bottom, 1, 1, data);
+		}
+		if (!ok) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static struct atlas_entry *atlas_alloc(struct wlr_texture_atlas *atlas,
+		uint32_t format, int width, int height) {
+	struct atlas_entry *entry = calloc(1, sizeof(*entry));
+	if (entry == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	struct atlas_page *page;
+	wl_list_for_each(page, &atlas->pages, link) {
+		if (page->format == format &&
+				page_alloc(page, width, height, &entry->box)) {
+			goto found;
+		}
+	}
+
+	page = page_create(atlas, format);
+	if (page == NULL || !page_alloc(page, width, height, &entry->box)) {
+		if (page != NULL) {
+			page_destroy(page);
+		}
+		free(entry);
+		return NULL;
+	}
+
+found:
+	entry->page = page;
+	wl_list_insert(&page->entries, &entry->link);
+	return entry;
+}
+
+struct wlr_texture *wlr_texture_atlas_find_buffer(
+		struct wlr_texture_atlas *atlas, struct wlr_buffer *buffer,
+		struct wlr_box *box) {
+	struct wlr_addon *addon =
+		wlr_addon_find(&buffer->addons, atlas, &entry_addon_impl);
+	if (addon == NULL) {
+		return NULL;
+	}
+	struct atlas_entry *entry = wl_container_of(addon, entry, addon);
+	*box = entry->box;
+	return entry->page->texture;
+}
+
+struct wlr_texture *wlr_texture_atlas_get_buffer(
+		struct wlr_texture_atlas *atlas, struct wlr_buffer *buffer,
+		struct wlr_box *box) {
+	struct wlr_texture *texture =
+		wlr_texture_atlas_find_buffer(atlas, buffer, box);
+	if (texture != NULL) {
+		return texture;
+	}
+
+	if (atlas->disabled || buffer->width <= 0 || buffer->height <= 0 ||
+			buffer->width > ATLAS_MAX_ENTRY_SIZE ||
+			buffer->height > ATLAS_MAX_ENTRY_SIZE) {
+		return NULL;
+	}
+
+	void *data;
+	uint32_t format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+		return NULL;
+	}
+
+	struct atlas_entry *entry =
+		atlas_alloc(atlas, format, buffer->width, buffer->height);
+	bool ok = entry != NULL && entry_write_pixels(entry, stride, data);
+	wlr_buffer_end_data_ptr_access(buffer);
+
+	if (entry == NULL) {
+		return NULL;
+	}
+	if (!ok) {
+		wlr_log(WLR_DEBUG, "Renderer doesn't support texture updates, "
+			"disabling texture atlas");
+		atlas->disabled = true;
+		entry_destroy(entry);
+		return NULL;
+	}
+
+	wlr_addon_init(&entry->addon, &buffer->addons, atlas, &entry_addon_impl);
+
+	*box = entry->box;
+	return entry->page->texture;
+}
@@ -1,6 +1,8 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_surface.h>
@@ -401,6 +403,10 @@ void wlr_output_destroy(struct wlr_output *output) {
 
 	wlr_swapchain_destroy(output->swapchain);
 
+	if (output->swapchain_trim_timer != NULL) {
+		wl_event_source_remove(output->swapchain_trim_timer);
+	}
+
 	if (output->idle_frame != NULL) {
 		wl_event_source_remove(output->idle_frame);
 	}
@@ -454,7 +460,20 @@ struct wlr_output_mode *wlr_output_preferred_mode(struct wlr_output *output) {
 	return wl_container_of(output->modes.next, mode, link);
 }
 
+static void output_state_clear_in_fence(struct wlr_output_state *state) {
+	if (!(state->committed & WLR_OUTPUT_STATE_IN_FENCE)) {
+		return;
+	}
+
+	close(state->in_fence_fd);
+	state->in_fence_fd = -1;
+
+	state->committed &= ~WLR_OUTPUT_STATE_IN_FENCE;
+}
+
 static void output_state_clear_buffer(struct wlr_output_state *state) {
+	output_state_clear_in_fence(state);
+
 	if (!(state->committed & WLR_OUTPUT_STATE_BUFFER)) {
 		return;
 	}
@@ -465,6 +484,19 @@ static void output_state_clear_buffer(struct wlr_output_state *state) {
 	state->committed &= ~WLR_OUTPUT_STATE_BUFFER;
 }
 
+void wlr_output_set_in_fence(struct wlr_output *output, int fd) {
+	output_state_clear_in_fence(&output->pending);
+
+	int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (dup_fd < 0) {
+		wlr_log_errno(WLR_ERROR, "fcntl(F_DUPFD_CLOEXEC) failed");
+		return;
+	}
+
+	output->pending.committed |= WLR_OUTPUT_STATE_IN_FENCE;
+	output->pending.in_fence_fd = dup_fd;
+}
+
 void wlr_output_set_damage(struct wlr_output *output,
 		pixman_region32_t *damage) {
 	pixman_region32_intersect_rect(&output->pending.damage, damage,
@@ -478,9 +510,16 @@ static void output_state_clear_gamma_lut(struct wlr_output_state *state) {
 	state->committed &= ~WLR_OUTPUT_STATE_GAMMA_LUT;
 }
 
+static void output_state_clear_overlays(struct wlr_output_state *state) {
+	state->overlays = NULL;
+	state->overlays_len = 0;
+	state->committed &= ~WLR_OUTPUT_STATE_OVERLAYS;
+}
+
 static void output_state_clear(struct wlr_output_state *state) {
 	output_state_clear_buffer(state);
 	output_state_clear_gamma_lut(state);
+	output_state_clear_overlays(state);
 	pixman_region32_clear(&state->damage);
 	state->committed = 0;
 }
@@ -573,6 +612,16 @@ static bool output_basic_test(struct wlr_output *output) {
 		wlr_log(WLR_DEBUG, "Tried to set the gamma lut on a disabled output");
 		return false;
 	}
+	if ((output->pending.committed & WLR_OUTPUT_STATE_OVERLAYS) &&
+			!(output->pending.committed & WLR_OUTPUT_STATE_BUFFER)) {
+		wlr_log(WLR_DEBUG, "Tried to set overlays without a buffer");
+		return false;
+	}
+	if ((output->pending.committed & WLR_OUTPUT_STATE_IN_FENCE) &&
+			!(output->pending.committed & WLR_OUTPUT_STATE_BUFFER)) {
+		wlr_log(WLR_DEBUG, "Tried to set an in fence without a buffer");
+		return false;
+	}
 
 	return true;
 }
@@ -623,6 +672,7 @@ bool wlr_output_commit(struct wlr_output *output) {
 	if ((output->pending.committed & WLR_OUTPUT_STATE_BUFFER) &&
 			output->back_buffer != NULL) {
 		back_buffer = wlr_buffer_lock(output->back_buffer);
+		output_export_render_fence(output);
 		output_clear_back_buffer(output);
 	}
 
@@ -678,6 +728,13 @@ bool wlr_output_commit(struct wlr_output *output) {
 		output->front_buffer = NULL;
 	}
 
+	if (output->pending.committed & WLR_OUTPUT_STATE_OVERLAYS) {
+		output->overlays_len = output->pending.overlays_len;
+	} else if ((output->pending.committed & WLR_OUTPUT_STATE_ENABLED) &&
+			!output->pending.enabled) {
+		output->overlays_len = 0;
+	}
+
 	if (output->pending.committed & WLR_OUTPUT_STATE_BUFFER) {
 		output->frame_pending = true;
 		output->needs_frame = false;
@@ -685,6 +742,7 @@ bool wlr_output_commit(struct wlr_output *output) {
 
 	if (back_buffer != NULL) {
 		wlr_swapchain_set_buffer_submitted(output->swapchain, back_buffer);
+		output_schedule_swapchain_trim(output);
 		wlr_buffer_unlock(output->front_buffer);
 		output->front_buffer = back_buffer;
 	}
@@ -714,6 +772,17 @@ void wlr_output_attach_buffer(struct wlr_output *output,
 	output->pending.buffer = wlr_buffer_lock(buffer);
 }
 
+void wlr_output_set_overlays(struct wlr_output *output,
+		const struct wlr_output_overlay *overlays, size_t overlays_len) {
+	if (overlays_len == 0 && output->overlays_len == 0) {
+		output_state_clear_overlays(&output->pending);
+		return;
+	}
+	output->pending.committed |= WLR_OUTPUT_STATE_OVERLAYS;
+	output->pending.overlays = overlays;
+	output->pending.overlays_len = overlays_len;
+}
+
 void wlr_output_send_frame(struct wlr_output *output) {
 	output->frame_pending = false;
 	if (output->enabled) {
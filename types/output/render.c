@@ -66,12 +66,70 @@ static bool output_create_swapchain(struct wlr_output *output,
 		return false;
 	}
 
+	if (output->swapchain_depth != 0) {
+		wlr_swapchain_set_capacity(swapchain, output->swapchain_depth);
+	}
+
 	wlr_swapchain_destroy(output->swapchain);
 	output->swapchain = swapchain;
 
 	return true;
 }
 
+void wlr_output_set_swapchain_depth(struct wlr_output *output, size_t depth) {
+	assert(depth == 0 || (depth >= 2 && depth <= WLR_SWAPCHAIN_CAP));
+	output->swapchain_depth = depth;
+
+	if (output->swapchain != NULL) {
+		wlr_swapchain_set_capacity(output->swapchain,
+			depth != 0 ? depth : WLR_SWAPCHAIN_CAP);
+	}
+}
+
+static int handle_swapchain_trim_timer(void *data) {
+	struct wlr_output *output = data;
+	if (output->swapchain != NULL) {
+		wlr_swapchain_trim(output->swapchain);
+	}
+	return 0;
+}
+
+void output_schedule_swapchain_trim(struct wlr_output *output) {
+	if (output->swapchain_trim_timer == NULL) {
+		struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+		output->swapchain_trim_timer = wl_event_loop_add_timer(ev,
+			handle_swapchain_trim_timer, output);
+		if (output->swapchain_trim_timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create swapchain trim timer");
+			return;
+		}
+	}
+
+	// Re-armed on each submission, so this only fires on idle outputs
+	wl_event_source_timer_update(output->swapchain_trim_timer,
+		WLR_SWAPCHAIN_IDLE_MS);
+}
+
+void wlr_output_get_swapchain_stats(struct wlr_output *output,
+		struct wlr_output_swapchain_stats *stats) {
+	*stats = (struct wlr_output_swapchain_stats){0};
+
+	struct wlr_swapchain *swapchain = output->swapchain;
+	if (swapchain == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		if (swapchain->slots[i].buffer != NULL) {
+			stats->buffers++;
+		}
+	}
+	stats->allocations = swapchain->stats.allocations;
+	stats->reuses = swapchain->stats.reuses;
+	stats->starvations = swapchain->stats.starvations;
+	stats->trims = swapchain->stats.trims;
+}
+
 static bool output_attach_back_buffer(struct wlr_output *output,
 		int *buffer_age) {
 	assert(output->back_buffer == NULL);
@@ -112,6 +170,25 @@ void output_clear_back_buffer(struct wlr_output *output) {
 	output->back_buffer = NULL;
 }
 
+void output_export_render_fence(struct wlr_output *output) {
+	if (output->back_buffer == NULL ||
+			output->pending.buffer != output->back_buffer ||
+			(output->pending.committed & WLR_OUTPUT_STATE_IN_FENCE)) {
+		return;
+	}
+
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	assert(renderer != NULL);
+
+	int fd = wlr_renderer_export_sync_file(renderer);
+	if (fd < 0) {
+		return;
+	}
+
+	output->pending.committed |= WLR_OUTPUT_STATE_IN_FENCE;
+	output->pending.in_fence_fd = fd;
+}
+
 bool wlr_output_attach_render(struct wlr_output *output, int *buffer_age) {
 	if (!output_attach_back_buffer(output, buffer_age)) {
 		return false;
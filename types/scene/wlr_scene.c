@@ -1,15 +1,22 @@
 #include <assert.h>
+#include <drm_fourcc.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wlr/backend.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture_atlas.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_surface.h>
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
+#include "backend/backend.h"
+#include "render/allocator/allocator.h"
+#include "render/pixel_format.h"
+#include "render/wlr_renderer.h"
 #include "util/signal.h"
+#include "util/time.h"
 
 static struct wlr_scene *scene_root_from_node(struct wlr_scene_node *node) {
 	assert(node->type == WLR_SCENE_NODE_ROOT);
@@ -49,6 +56,94 @@ static void scene_node_state_finish(struct wlr_scene_node_state *state) {
 	wl_list_remove(&state->link);
 }
 
+static struct wlr_scene *scene_node_get_root(struct wlr_scene_node *node) {
+	while (node->parent != NULL) {
+		node = node->parent;
+	}
+	return scene_root_from_node(node);
+}
+
+/**
+ * The rendering of a cached tree's descendants for a renderer and a scale. A
+ * tree displayed on outputs with different scales has one for each scale.
+ */
+struct scene_tree_cache {
+	struct wl_list link; // wlr_scene_tree.caches
+	struct wlr_renderer *renderer;
+	float scale;
+	// Fractional part of the scaled layout position of the tree's bounding
+	// box, which determines how children edges are rounded
+	double phase_x, phase_y;
+	bool dirty;
+	struct wlr_buffer *buffer;
+	struct wlr_texture *texture; // NULL if not rendered yet
+};
+
+struct scene_overlay {
+	struct wlr_scene_node *node;
+	struct wlr_box box; // in output-local coordinates
+	struct wlr_output_overlay overlay;
+};
+
+/**
+ * Mark the render lists of all outputs as outdated. This needs to be called
+ * whenever a node's position, size, stacking order or visibility changes.
+ */
+static void scene_node_invalidate_render_lists(struct wlr_scene_node *node) {
+	struct wlr_scene *scene = scene_node_get_root(node);
+	struct wlr_scene_output *scene_output;
+	wl_list_for_each(scene_output, &scene->outputs, link) {
+		scene_output->render_list_dirty = true;
+	}
+}
+
+/**
+ * Mark the caches of all trees containing the node as outdated. This needs to
+ * be called whenever the node's appearance changes.
+ */
+static void scene_node_invalidate_caches(struct wlr_scene_node *node) {
+	for (node = node->parent; node != NULL; node = node->parent) {
+		if (node->type != WLR_SCENE_NODE_TREE) {
+			continue;
+		}
+		struct wlr_scene_tree *tree = scene_tree_from_node(node);
+		struct scene_tree_cache *cache;
+		wl_list_for_each(cache, &tree->caches, link) {
+			cache->dirty = true;
+		}
+	}
+}
+
+static void scene_tree_cache_destroy(struct scene_tree_cache *cache) {
+	wl_list_remove(&cache->link);
+	wlr_texture_destroy(cache->texture);
+	wlr_buffer_drop(cache->buffer);
+	free(cache);
+}
+
+static void scene_tree_finish_cache(struct wlr_scene_tree *tree) {
+	struct scene_tree_cache *cache, *tmp;
+	wl_list_for_each_safe(cache, tmp, &tree->caches, link) {
+		scene_tree_cache_destroy(cache);
+	}
+}
+
+/**
+ * Mark the bounding box and region of a node and of all of its ancestors as
+ * outdated.
+ *
+ * Changes to the position, the enabled state or the parent of a node don't
+ * affect the node's own bounding box: only its parent needs to be invalidated.
+ */
+static void scene_node_invalidate_bounds(struct wlr_scene_node *node) {
+	// If a node is already dirty, so are its ancestors
+	while (node != NULL && !(node->bounds_dirty && node->region_dirty)) {
+		node->bounds_dirty = true;
+		node->region_dirty = true;
+		node = node->parent;
+	}
+}
+
 static void scene_node_init(struct wlr_scene_node *node,
 		enum wlr_scene_node_type type, struct wlr_scene_node *parent) {
 	assert(type == WLR_SCENE_NODE_ROOT || parent != NULL);
@@ -57,9 +152,14 @@ static void scene_node_init(struct wlr_scene_node *node,
 	node->parent = parent;
 	scene_node_state_init(&node->state);
 	wl_signal_init(&node->events.destroy);
+	pixman_region32_init(&node->region);
+	node->bounds_dirty = true;
+	node->region_dirty = true;
 
 	if (parent != NULL) {
 		wl_list_insert(parent->state.children.prev, &node->state.link);
+		scene_node_invalidate_bounds(parent);
+		scene_node_invalidate_render_lists(parent);
 	}
 }
 
@@ -73,6 +173,7 @@ static void scene_node_finish(struct wlr_scene_node *node) {
 	}
 
 	scene_node_state_finish(&node->state);
+	pixman_region32_fini(&node->region);
 }
 
 static void scene_node_damage_whole(struct wlr_scene_node *node);
@@ -83,6 +184,31 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 	}
 
 	scene_node_damage_whole(node);
+	scene_node_invalidate_bounds(node->parent);
+	scene_node_invalidate_render_lists(node);
+
+	struct wlr_scene *root = scene_node_get_root(node);
+	struct wlr_scene_output *output;
+	wl_list_for_each(output, &root->outputs, link) {
+		struct scene_overlay *overlay;
+		wl_array_for_each(overlay, &output->overlays) {
+			if (overlay->node == node) {
+				overlay->node = NULL;
+			}
+		}
+
+		if (node->type == WLR_SCENE_NODE_SURFACE &&
+				(wlr_scene_surface_from_node(node)->visible_outputs &
+				((uint64_t)1 << output->index))) {
+			struct wlr_scene_surface **visible;
+			wl_array_for_each(visible, &output->visible_surfaces) {
+				if (*visible != NULL && &(*visible)->node == node) {
+					*visible = NULL;
+				}
+			}
+		}
+	}
+
 	scene_node_finish(node);
 
 	switch (node->type) {
@@ -98,12 +224,14 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 		break;
 	case WLR_SCENE_NODE_TREE:;
 		struct wlr_scene_tree *tree = scene_tree_from_node(node);
+		scene_tree_finish_cache(tree);
 		free(tree);
 		break;
 	case WLR_SCENE_NODE_SURFACE:;
 		struct wlr_scene_surface *scene_surface = wlr_scene_surface_from_node(node);
 		wl_list_remove(&scene_surface->surface_commit.link);
 		wl_list_remove(&scene_surface->surface_destroy.link);
+		wl_list_remove(&scene_surface->hidden_link);
 		free(scene_surface);
 		break;
 	case WLR_SCENE_NODE_RECT:;
@@ -126,19 +254,106 @@ struct wlr_scene *wlr_scene_create(void) {
 	}
 	scene_node_init(&scene->node, WLR_SCENE_NODE_ROOT, NULL);
 	wl_list_init(&scene->outputs);
+	wl_list_init(&scene->hidden_surfaces);
+	scene->hidden_frame_interval_ms = 1000;
 	return scene;
 }
 
+void wlr_scene_set_hidden_frame_interval(struct wlr_scene *scene,
+		int interval_ms) {
+	assert(interval_ms >= 0);
+	scene->hidden_frame_interval_ms = interval_ms;
+}
+
+/**
+ * Add the buffer to the scene's texture atlas, if any. Buffers don't change
+ * after the node is created, so this only needs to happen once per node and
+ * when the atlas is set.
+ */
+static void scene_buffer_update_atlas(struct wlr_scene_buffer *scene_buffer) {
+	if (scene_buffer->buffer == NULL ||
+			wlr_client_buffer_get(scene_buffer->buffer) != NULL) {
+		return;
+	}
+
+	struct wlr_scene *scene = scene_node_get_root(&scene_buffer->node);
+	struct wlr_texture_atlas *atlas = scene->texture_atlas;
+	if (atlas == NULL) {
+		return;
+	}
+
+	// Buffers which don't fit get their own texture when rendered
+	struct wlr_box box;
+	if (wlr_texture_atlas_find_buffer(atlas, scene_buffer->buffer,
+			&box) == NULL && wlr_texture_atlas_get_buffer(atlas,
+			scene_buffer->buffer, &box) == NULL) {
+		return;
+	}
+
+	// Atlas entries are only made for buffers with data pointer access
+	void *data;
+	uint32_t format;
+	size_t stride;
+	scene_buffer->atlas_opaque = false;
+	if (wlr_buffer_begin_data_ptr_access(scene_buffer->buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+		const struct wlr_pixel_format_info *info =
+			drm_get_pixel_format_info(format);
+		scene_buffer->atlas_opaque = info != NULL && !info->has_alpha;
+		wlr_buffer_end_data_ptr_access(scene_buffer->buffer);
+	}
+
+	wlr_texture_destroy(scene_buffer->texture);
+	scene_buffer->texture = NULL;
+}
+
+static void scene_node_update_atlas(struct wlr_scene_node *node) {
+	if (node->type == WLR_SCENE_NODE_BUFFER) {
+		scene_buffer_update_atlas(scene_buffer_from_node(node));
+	}
+
+	// Disabled nodes included, so that they're ready once enabled
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &node->state.children, state.link) {
+		scene_node_update_atlas(child);
+	}
+}
+
+void wlr_scene_set_texture_atlas(struct wlr_scene *scene,
+		struct wlr_texture_atlas *atlas) {
+	if (scene->texture_atlas == atlas) {
+		return;
+	}
+	scene->texture_atlas = atlas;
+	if (atlas != NULL) {
+		scene_node_update_atlas(&scene->node);
+	}
+	scene_node_damage_whole(&scene->node);
+}
+
 struct wlr_scene_tree *wlr_scene_tree_create(struct wlr_scene_node *parent) {
 	struct wlr_scene_tree *tree = calloc(1, sizeof(struct wlr_scene_tree));
 	if (tree == NULL) {
 		return NULL;
 	}
 	scene_node_init(&tree->node, WLR_SCENE_NODE_TREE, parent);
+	wl_list_init(&tree->caches);
 
 	return tree;
 }
 
+void wlr_scene_tree_set_cached(struct wlr_scene_tree *tree, bool cached) {
+	if (tree->cached == cached) {
+		return;
+	}
+
+	tree->cached = cached;
+	if (!cached) {
+		scene_tree_finish_cache(tree);
+	}
+	scene_node_invalidate_render_lists(&tree->node);
+}
+
 static void scene_surface_handle_surface_destroy(struct wl_listener *listener,
 		void *data) {
 	struct wlr_scene_surface *scene_surface =
@@ -146,11 +361,96 @@ static void scene_surface_handle_surface_destroy(struct wl_listener *listener,
 	wlr_scene_node_destroy(&scene_surface->node);
 }
 
-static struct wlr_scene *scene_node_get_root(struct wlr_scene_node *node) {
-	while (node->parent != NULL) {
-		node = node->parent;
+static int scale_length(int length, int offset, float scale) {
+	return round((offset + length) * scale) - round(offset * scale);
+}
+
+static void scale_box(struct wlr_box *box, float scale) {
+	box->width = scale_length(box->width, box->x, scale);
+	box->height = scale_length(box->height, box->y, scale);
+	box->x = round(box->x * scale);
+	box->y = round(box->y * scale);
+}
+
+/**
+ * Map a buffer-local coordinate range to the output pixels whose color
+ * depends on it. The range is expanded by half a texel on each side to
+ * account for bilinear filtering, and the output pixels are sampled at their
+ * center. Pixels with a null filter weight are left out, so that a 1:1
+ * mapping doesn't expand the damage at all.
+ */
+static void map_damage_range(double start, double end, int offset,
+		double scale, int32_t *out_start, int32_t *out_end) {
+	double mapped_start = offset + (start - 0.5) * scale;
+	double mapped_end = offset + (end + 0.5) * scale;
+	*out_start = floor(mapped_start - 0.5) + 1;
+	*out_end = ceil(mapped_end - 0.5);
+}
+
+/**
+ * Get the output pixels affected by the surface's buffer damage. The buffer
+ * damage is mapped through the viewport, the buffer transform and the output
+ * scale without intermediate rounding. The box is the surface's box in
+ * output-buffer-local coordinates, as used for rendering.
+ */
+static void scene_surface_get_output_damage(
+		struct wlr_scene_surface *scene_surface, const struct wlr_box *box,
+		pixman_region32_t *damage) {
+	struct wlr_surface *surface = scene_surface->surface;
+
+	pixman_region32_clear(damage);
+	if (wlr_box_empty(box)) {
+		return;
 	}
-	return scene_root_from_node(node);
+
+	struct wlr_fbox src_box;
+	wlr_surface_get_buffer_source_box(surface, &src_box);
+	if (wlr_fbox_empty(&src_box)) {
+		return;
+	}
+
+	enum wl_output_transform transform = surface->current.transform;
+	double tr_width = src_box.width, tr_height = src_box.height;
+	if (transform & WL_OUTPUT_TRANSFORM_90) {
+		tr_width = src_box.height;
+		tr_height = src_box.width;
+	}
+	double scale_x = box->width / tr_width;
+	double scale_y = box->height / tr_height;
+
+	int nrects;
+	pixman_box32_t *src_rects =
+		pixman_region32_rectangles(&surface->buffer_damage, &nrects);
+
+	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	if (dst_rects == NULL) {
+		pixman_region32_union_rect(damage, damage,
+			box->x, box->y, box->width, box->height);
+		return;
+	}
+
+	for (int i = 0; i < nrects; ++i) {
+		struct wlr_fbox rect = {
+			.x = src_rects[i].x1 - src_box.x,
+			.y = src_rects[i].y1 - src_box.y,
+			.width = src_rects[i].x2 - src_rects[i].x1,
+			.height = src_rects[i].y2 - src_rects[i].y1,
+		};
+		wlr_fbox_transform(&rect, &rect, transform,
+			src_box.width, src_box.height);
+
+		map_damage_range(rect.x, rect.x + rect.width, box->x, scale_x,
+			&dst_rects[i].x1, &dst_rects[i].x2);
+		map_damage_range(rect.y, rect.y + rect.height, box->y, scale_y,
+			&dst_rects[i].y1, &dst_rects[i].y2);
+	}
+
+	pixman_region32_fini(damage);
+	pixman_region32_init_rects(damage, dst_rects, nrects);
+	free(dst_rects);
+
+	pixman_region32_intersect_rect(damage, damage,
+		box->x, box->y, box->width, box->height);
 }
 
 static void scene_surface_handle_surface_commit(struct wl_listener *listener,
@@ -159,10 +459,18 @@ static void scene_surface_handle_surface_commit(struct wl_listener *listener,
 		wl_container_of(listener, scene_surface, surface_commit);
 	struct wlr_surface *surface = scene_surface->surface;
 
+	if (surface->current.width != surface->previous.width ||
+			surface->current.height != surface->previous.height) {
+		scene_node_invalidate_bounds(&scene_surface->node);
+		scene_node_invalidate_render_lists(&scene_surface->node);
+	}
+
 	if (!pixman_region32_not_empty(&surface->buffer_damage)) {
 		return;
 	}
 
+	scene_node_invalidate_caches(&scene_surface->node);
+
 	int lx, ly;
 	if (!wlr_scene_node_coords(&scene_surface->node, &lx, &ly)) {
 		return;
@@ -172,22 +480,33 @@ static void scene_surface_handle_surface_commit(struct wl_listener *listener,
 
 	struct wlr_scene_output *scene_output;
 	wl_list_for_each(scene_output, &scene->outputs, link) {
-		struct wlr_output *output = scene_output->output;
+		struct wlr_box box = {
+			.x = lx - scene_output->x,
+			.y = ly - scene_output->y,
+			.width = surface->current.width,
+			.height = surface->current.height,
+		};
+		scale_box(&box, scene_output->output->scale);
 
 		pixman_region32_t damage;
 		pixman_region32_init(&damage);
-		wlr_surface_get_effective_damage(surface, &damage);
-
-		pixman_region32_translate(&damage,
-			lx - scene_output->x, ly - scene_output->y);
-
-		wlr_region_scale(&damage, &damage, output->scale);
-		if (ceil(output->scale) > surface->current.scale) {
-			// When scaling up a surface it'll become blurry, so we need to
-			// expand the damage region.
-			wlr_region_expand(&damage, &damage,
-				ceil(output->scale) - surface->current.scale);
+		scene_surface_get_output_damage(scene_surface, &box, &damage);
+
+		// On resize or move, damage the previous bounds of the surface
+		if (surface->previous.width > surface->current.width ||
+				surface->previous.height > surface->current.height ||
+				surface->current.dx != 0 || surface->current.dy != 0) {
+			pixman_region32_t prev_damage;
+			pixman_region32_init(&prev_damage);
+			wlr_surface_get_effective_damage(surface, &prev_damage);
+			pixman_region32_translate(&prev_damage,
+				lx - scene_output->x, ly - scene_output->y);
+			wlr_region_scale(&prev_damage, &prev_damage,
+				scene_output->output->scale);
+			pixman_region32_union(&damage, &damage, &prev_damage);
+			pixman_region32_fini(&prev_damage);
 		}
+
 		wlr_output_damage_add(scene_output->damage, &damage);
 		pixman_region32_fini(&damage);
 	}
@@ -210,11 +529,36 @@ struct wlr_scene_surface *wlr_scene_surface_create(struct wlr_scene_node *parent
 	scene_surface->surface_commit.notify = scene_surface_handle_surface_commit;
 	wl_signal_add(&surface->events.commit, &scene_surface->surface_commit);
 
+	// Hidden until an output it's visible on is committed
+	struct wlr_scene *scene = scene_node_get_root(parent);
+	wl_list_insert(&scene->hidden_surfaces, &scene_surface->hidden_link);
+
 	scene_node_damage_whole(&scene_surface->node);
 
 	return scene_surface;
 }
 
+/**
+ * Update the set of outputs the surface is visible on, and whether it's in the
+ * scene's list of hidden surfaces accordingly.
+ */
+static void scene_surface_set_visible_outputs(
+		struct wlr_scene_surface *scene_surface, uint64_t visible_outputs) {
+	bool was_hidden = scene_surface->visible_outputs == 0;
+	scene_surface->visible_outputs = visible_outputs;
+	if (was_hidden == (visible_outputs == 0)) {
+		return;
+	}
+
+	if (visible_outputs == 0) {
+		struct wlr_scene *scene = scene_node_get_root(&scene_surface->node);
+		wl_list_insert(&scene->hidden_surfaces, &scene_surface->hidden_link);
+	} else {
+		wl_list_remove(&scene_surface->hidden_link);
+		wl_list_init(&scene_surface->hidden_link);
+	}
+}
+
 struct wlr_scene_rect *wlr_scene_rect_create(struct wlr_scene_node *parent,
 		int width, int height, const float color[static 4]) {
 	struct wlr_scene_rect *scene_rect =
@@ -241,6 +585,8 @@ void wlr_scene_rect_set_size(struct wlr_scene_rect *rect, int width, int height)
 	scene_node_damage_whole(&rect->node);
 	rect->width = width;
 	rect->height = height;
+	scene_node_invalidate_bounds(&rect->node);
+	scene_node_invalidate_render_lists(&rect->node);
 	scene_node_damage_whole(&rect->node);
 }
 
@@ -262,6 +608,7 @@ struct wlr_scene_buffer *wlr_scene_buffer_create(struct wlr_scene_node *parent,
 	scene_node_init(&scene_buffer->node, WLR_SCENE_NODE_BUFFER, parent);
 
 	scene_buffer->buffer = wlr_buffer_lock(buffer);
+	scene_buffer_update_atlas(scene_buffer);
 
 	scene_node_damage_whole(&scene_buffer->node);
 
@@ -294,6 +641,8 @@ void wlr_scene_buffer_set_dest_size(struct wlr_scene_buffer *scene_buffer,
 	scene_node_damage_whole(&scene_buffer->node);
 	scene_buffer->dst_width = width;
 	scene_buffer->dst_height = height;
+	scene_node_invalidate_bounds(&scene_buffer->node);
+	scene_node_invalidate_render_lists(&scene_buffer->node);
 	scene_node_damage_whole(&scene_buffer->node);
 }
 
@@ -305,24 +654,71 @@ void wlr_scene_buffer_set_transform(struct wlr_scene_buffer *scene_buffer,
 
 	scene_node_damage_whole(&scene_buffer->node);
 	scene_buffer->transform = transform;
+	scene_node_invalidate_bounds(&scene_buffer->node);
+	scene_node_invalidate_render_lists(&scene_buffer->node);
 	scene_node_damage_whole(&scene_buffer->node);
 }
 
+/**
+ * Get the texture to draw the buffer node with. If src_box isn't NULL, it's
+ * filled with the area of the texture to sample. If opaque isn't NULL, it's
+ * set to whether the buffer's contents are fully opaque.
+ */
 static struct wlr_texture *scene_buffer_get_texture(
-		struct wlr_scene_buffer *scene_buffer, struct wlr_renderer *renderer) {
+		struct wlr_scene_buffer *scene_buffer, struct wlr_renderer *renderer,
+		struct wlr_fbox *src_box, bool *opaque) {
+	if (src_box != NULL) {
+		*src_box = scene_buffer->src_box;
+	}
+
+	struct wlr_texture *texture = NULL;
 	struct wlr_client_buffer *client_buffer =
 		wlr_client_buffer_get(scene_buffer->buffer);
 	if (client_buffer != NULL) {
-		return client_buffer->texture;
+		texture = client_buffer->texture;
+		goto out;
+	}
+
+	struct wlr_scene *scene = scene_node_get_root(&scene_buffer->node);
+	struct wlr_texture_atlas *atlas = scene->texture_atlas;
+	if (atlas != NULL && atlas->renderer == renderer) {
+		// Buffers are added to the atlas when the node is created, see
+		// scene_buffer_update_atlas()
+		struct wlr_box box;
+		texture = wlr_texture_atlas_find_buffer(atlas,
+			scene_buffer->buffer, &box);
+		if (texture != NULL) {
+			if (src_box != NULL) {
+				if (wlr_fbox_empty(src_box)) {
+					*src_box = (struct wlr_fbox){
+						.width = box.width,
+						.height = box.height,
+					};
+				}
+				src_box->x += box.x;
+				src_box->y += box.y;
+			}
+			// The page's format says nothing about the buffer's
+			if (opaque != NULL) {
+				*opaque = scene_buffer->atlas_opaque;
+			}
+			return texture;
+		}
 	}
 
-	if (scene_buffer->texture != NULL) {
-		return scene_buffer->texture;
+	// Buffers which aren't in the atlas get their own texture. It's released
+	// if the buffer is added to the atlas later on.
+	if (scene_buffer->texture == NULL) {
+		scene_buffer->texture =
+			wlr_texture_from_buffer(renderer, scene_buffer->buffer);
 	}
+	texture = scene_buffer->texture;
 
-	scene_buffer->texture =
-		wlr_texture_from_buffer(renderer, scene_buffer->buffer);
-	return scene_buffer->texture;
+out:
+	if (opaque != NULL) {
+		*opaque = texture != NULL && wlr_texture_is_opaque(texture);
+	}
+	return texture;
 }
 
 static void scene_node_get_size(struct wlr_scene_node *node,
@@ -363,48 +759,108 @@ static void scene_node_get_size(struct wlr_scene_node *node,
 	}
 }
 
-static int scale_length(int length, int offset, float scale) {
-	return round((offset + length) * scale) - round(offset * scale);
-}
+static void box_union(struct wlr_box *dest, const struct wlr_box *box) {
+	if (wlr_box_empty(box)) {
+		return;
+	}
+	if (wlr_box_empty(dest)) {
+		*dest = *box;
+		return;
+	}
 
-static void scale_box(struct wlr_box *box, float scale) {
-	box->width = scale_length(box->width, box->x, scale);
-	box->height = scale_length(box->height, box->y, scale);
-	box->x = round(box->x * scale);
-	box->y = round(box->y * scale);
+	int x1 = dest->x < box->x ? dest->x : box->x;
+	int y1 = dest->y < box->y ? dest->y : box->y;
+	int x2 = dest->x + dest->width > box->x + box->width ?
+		dest->x + dest->width : box->x + box->width;
+	int y2 = dest->y + dest->height > box->y + box->height ?
+		dest->y + dest->height : box->y + box->height;
+	*dest = (struct wlr_box){
+		.x = x1,
+		.y = y1,
+		.width = x2 - x1,
+		.height = y2 - y1,
+	};
 }
 
-static void _scene_node_damage_whole(struct wlr_scene_node *node,
-		struct wlr_scene *scene, int lx, int ly) {
-	if (!node->state.enabled) {
+static void scene_node_update_bounds(struct wlr_scene_node *node) {
+	if (!node->bounds_dirty) {
 		return;
 	}
 
+	struct wlr_box bounds = {0};
+	scene_node_get_size(node, &bounds.width, &bounds.height);
+
 	struct wlr_scene_node *child;
 	wl_list_for_each(child, &node->state.children, state.link) {
-		_scene_node_damage_whole(child, scene,
-			lx + child->state.x, ly + child->state.y);
+		if (!child->state.enabled) {
+			continue;
+		}
+
+		scene_node_update_bounds(child);
+		struct wlr_box child_bounds = child->bounds;
+		child_bounds.x += child->state.x;
+		child_bounds.y += child->state.y;
+		box_union(&bounds, &child_bounds);
+	}
+
+	node->bounds = bounds;
+	node->bounds_dirty = false;
+}
+
+/**
+ * Re-compute the region covered by the node and its enabled descendants,
+ * relative to the node's position. Unlike the bounding box, this is only
+ * needed to damage a node as a whole.
+ */
+static void scene_node_update_region(struct wlr_scene_node *node) {
+	if (!node->region_dirty) {
+		return;
 	}
 
 	int width, height;
 	scene_node_get_size(node, &width, &height);
+	pixman_region32_fini(&node->region);
+	pixman_region32_init_rect(&node->region, 0, 0, width, height);
 
-	struct wlr_scene_output *scene_output;
-	wl_list_for_each(scene_output, &scene->outputs, link) {
-		struct wlr_box box = {
-			.x = lx - scene_output->x,
-			.y = ly - scene_output->y,
-			.width = width,
-			.height = height,
-		};
-
-		scale_box(&box, scene_output->output->scale);
+	pixman_region32_t child_region;
+	pixman_region32_init(&child_region);
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &node->state.children, state.link) {
+		if (!child->state.enabled) {
+			continue;
+		}
 
-		wlr_output_damage_add_box(scene_output->damage, &box);
+		scene_node_update_region(child);
+		pixman_region32_copy(&child_region, &child->region);
+		pixman_region32_translate(&child_region,
+			child->state.x, child->state.y);
+		pixman_region32_union(&node->region, &node->region, &child_region);
 	}
+	pixman_region32_fini(&child_region);
+
+	node->region_dirty = false;
 }
 
+/**
+ * Get the bounding box of the node and all of its enabled descendants,
+ * relative to the node's position. The result is cached until the node is
+ * invalidated via scene_node_invalidate_bounds().
+ */
+static void scene_node_get_bounds(struct wlr_scene_node *node,
+		struct wlr_box *box) {
+	scene_node_update_bounds(node);
+	*box = node->bounds;
+}
+
+/**
+ * Damage the area covered by the node and its descendants on all outputs.
+ *
+ * The covered region is cached, so that moving or restacking a node whose
+ * subtree hasn't changed doesn't walk its descendants.
+ */
 static void scene_node_damage_whole(struct wlr_scene_node *node) {
+	scene_node_invalidate_caches(node);
+
 	struct wlr_scene *scene = scene_node_get_root(node);
 	if (wl_list_empty(&scene->outputs)) {
 		return;
@@ -415,7 +871,22 @@ static void scene_node_damage_whole(struct wlr_scene_node *node) {
 		return;
 	}
 
-	_scene_node_damage_whole(node, scene, lx, ly);
+	scene_node_update_region(node);
+	if (!pixman_region32_not_empty(&node->region)) {
+		return;
+	}
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	struct wlr_scene_output *scene_output;
+	wl_list_for_each(scene_output, &scene->outputs, link) {
+		pixman_region32_copy(&damage, &node->region);
+		pixman_region32_translate(&damage,
+			lx - scene_output->x, ly - scene_output->y);
+		wlr_region_scale(&damage, &damage, scene_output->output->scale);
+		wlr_output_damage_add(scene_output->damage, &damage);
+	}
+	pixman_region32_fini(&damage);
 }
 
 void wlr_scene_node_set_enabled(struct wlr_scene_node *node, bool enabled) {
@@ -426,6 +897,8 @@ void wlr_scene_node_set_enabled(struct wlr_scene_node *node, bool enabled) {
 	// One of these damage_whole() calls will short-circuit and be a no-op
 	scene_node_damage_whole(node);
 	node->state.enabled = enabled;
+	scene_node_invalidate_bounds(node->parent);
+	scene_node_invalidate_render_lists(node);
 	scene_node_damage_whole(node);
 }
 
@@ -437,6 +910,8 @@ void wlr_scene_node_set_position(struct wlr_scene_node *node, int x, int y) {
 	scene_node_damage_whole(node);
 	node->state.x = x;
 	node->state.y = y;
+	scene_node_invalidate_bounds(node->parent);
+	scene_node_invalidate_render_lists(node);
 	scene_node_damage_whole(node);
 }
 
@@ -451,6 +926,7 @@ void wlr_scene_node_place_above(struct wlr_scene_node *node,
 
 	wl_list_remove(&node->state.link);
 	wl_list_insert(&sibling->state.link, &node->state.link);
+	scene_node_invalidate_render_lists(node);
 
 	scene_node_damage_whole(node);
 	scene_node_damage_whole(sibling);
@@ -467,6 +943,7 @@ void wlr_scene_node_place_below(struct wlr_scene_node *node,
 
 	wl_list_remove(&node->state.link);
 	wl_list_insert(sibling->state.link.prev, &node->state.link);
+	scene_node_invalidate_render_lists(node);
 
 	scene_node_damage_whole(node);
 	scene_node_damage_whole(sibling);
@@ -505,11 +982,14 @@ void wlr_scene_node_reparent(struct wlr_scene_node *node,
 	}
 
 	scene_node_damage_whole(node);
+	scene_node_invalidate_bounds(node->parent);
 
 	wl_list_remove(&node->state.link);
 	node->parent = new_parent;
 	wl_list_insert(new_parent->state.children.prev, &node->state.link);
 
+	scene_node_invalidate_bounds(new_parent);
+	scene_node_invalidate_render_lists(node);
 	scene_node_damage_whole(node);
 }
 
@@ -561,10 +1041,16 @@ struct wlr_scene_node *wlr_scene_node_at(struct wlr_scene_node *node,
 		return NULL;
 	}
 
-	// TODO: optimize by storing a bounding box in each node?
 	lx -= node->state.x;
 	ly -= node->state.y;
 
+	// Skip the whole sub-tree if the point is outside of its bounding box
+	struct wlr_box bounds;
+	scene_node_get_bounds(node, &bounds);
+	if (!wlr_box_contains_point(&bounds, lx, ly)) {
+		return NULL;
+	}
+
 	struct wlr_scene_node *child;
 	wl_list_for_each_reverse(child, &node->state.children, state.link) {
 		struct wlr_scene_node *node =
@@ -604,55 +1090,107 @@ struct wlr_scene_node *wlr_scene_node_at(struct wlr_scene_node *node,
 	return NULL;
 }
 
-static void scissor_output(struct wlr_output *output, pixman_box32_t *rect) {
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
-	assert(renderer);
+struct render_data {
+	struct wlr_renderer *renderer;
+	enum wl_output_transform transform;
+	const float *transform_matrix;
+	float scale;
+	int width, height; // render target size, after transform
+	int origin_x, origin_y; // subtracted from node boxes once scaled
+	pixman_region32_t *damage;
+	struct wl_array *quads; // struct wlr_render_quad, submitted at once
+};
 
-	struct wlr_box box = {
+static void render_data_init_output(struct render_data *data,
+		struct wlr_output *output, pixman_region32_t *damage) {
+	data->renderer = wlr_backend_get_renderer(output->backend);
+	assert(data->renderer);
+	data->transform = output->transform;
+	data->transform_matrix = output->transform_matrix;
+	data->scale = output->scale;
+	wlr_output_transformed_resolution(output, &data->width, &data->height);
+	data->origin_x = data->origin_y = 0;
+	data->damage = damage;
+	data->quads = NULL;
+}
+
+static void get_render_target_box(const struct render_data *data,
+		const pixman_box32_t *rect, struct wlr_box *box) {
+	*box = (struct wlr_box){
 		.x = rect->x1,
 		.y = rect->y1,
 		.width = rect->x2 - rect->x1,
 		.height = rect->y2 - rect->y1,
 	};
 
-	int ow, oh;
-	wlr_output_transformed_resolution(output, &ow, &oh);
-
 	enum wl_output_transform transform =
-		wlr_output_transform_invert(output->transform);
-	wlr_box_transform(&box, &box, transform, ow, oh);
+		wlr_output_transform_invert(data->transform);
+	wlr_box_transform(box, box, transform, data->width, data->height);
+}
+
+static void scissor_output(struct wlr_output *output, pixman_box32_t *rect) {
+	struct render_data data;
+	render_data_init_output(&data, output, NULL);
+
+	struct wlr_box box;
+	get_render_target_box(&data, rect, &box);
+	wlr_renderer_scissor(data.renderer, &box);
+}
+
+/**
+ * Queue one copy of the quad per rectangle of the damage region, clipped to
+ * that rectangle.
+ */
+static void add_render_quads(const struct render_data *data,
+		const struct wlr_render_quad *quad, pixman_region32_t *damage) {
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		struct wlr_render_quad *entry =
+			wl_array_add(data->quads, sizeof(*entry));
+		if (entry == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return;
+		}
+		*entry = *quad;
+		get_render_target_box(data, &rects[i], &entry->clip);
+	}
+}
 
-	wlr_renderer_scissor(renderer, &box);
+static void flush_render_quads(const struct render_data *data) {
+	const struct wlr_render_quad *quads = data->quads->data;
+	size_t quads_len = data->quads->size / sizeof(quads[0]);
+	if (quads_len > 0) {
+		wlr_render_quads(data->renderer, quads, quads_len);
+	}
+	data->quads->size = 0;
 }
 
-static void render_rect(struct wlr_output *output,
+static void render_rect(const struct render_data *data,
 		pixman_region32_t *output_damage, const float color[static 4],
 		const struct wlr_box *box, const float matrix[static 9]) {
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
-	assert(renderer);
+	if (wlr_box_empty(box)) {
+		return;
+	}
 
 	pixman_region32_t damage;
 	pixman_region32_init(&damage);
 	pixman_region32_init_rect(&damage, box->x, box->y, box->width, box->height);
 	pixman_region32_intersect(&damage, &damage, output_damage);
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_render_rect(renderer, box, color, matrix);
-	}
+	struct wlr_render_quad quad = {0};
+	memcpy(quad.color, color, sizeof(quad.color));
+	wlr_matrix_project_box(quad.matrix, box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
+		matrix);
+	add_render_quads(data, &quad, &damage);
 
 	pixman_region32_fini(&damage);
 }
 
-static void render_texture(struct wlr_output *output,
+static void render_texture(const struct render_data *data,
 		pixman_region32_t *output_damage, struct wlr_texture *texture,
 		const struct wlr_fbox *src_box, const struct wlr_box *dst_box,
 		const float matrix[static 9]) {
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
-	assert(renderer);
-
 	struct wlr_fbox default_src_box = {0};
 	if (wlr_fbox_empty(src_box)) {
 		default_src_box.width = dst_box->width;
@@ -666,25 +1204,20 @@ static void render_texture(struct wlr_output *output,
 		dst_box->width, dst_box->height);
 	pixman_region32_intersect(&damage, &damage, output_damage);
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_render_subtexture_with_matrix(renderer, texture, src_box, matrix, 1.0);
-	}
+	struct wlr_render_quad quad = {
+		.texture = texture,
+		.src_box = *src_box,
+		.alpha = 1.0,
+	};
+	memcpy(quad.matrix, matrix, sizeof(quad.matrix));
+	add_render_quads(data, &quad, &damage);
 
 	pixman_region32_fini(&damage);
 }
 
-struct render_data {
-	struct wlr_output *output;
-	pixman_region32_t *damage;
-};
-
 static void render_node_iterator(struct wlr_scene_node *node,
 		int x, int y, void *_data) {
 	struct render_data *data = _data;
-	struct wlr_output *output = data->output;
 	pixman_region32_t *output_damage = data->damage;
 
 	struct wlr_box dst_box = {
@@ -692,7 +1225,9 @@ static void render_node_iterator(struct wlr_scene_node *node,
 		.y = y,
 	};
 	scene_node_get_size(node, &dst_box.width, &dst_box.height);
-	scale_box(&dst_box, output->scale);
+	scale_box(&dst_box, data->scale);
+	dst_box.x -= data->origin_x;
+	dst_box.y -= data->origin_y;
 
 	struct wlr_texture *texture;
 	float matrix[9];
@@ -711,32 +1246,37 @@ static void render_node_iterator(struct wlr_scene_node *node,
 			return;
 		}
 
+		struct wlr_fbox src_box;
+		wlr_surface_get_buffer_source_box(surface, &src_box);
+
 		transform = wlr_output_transform_invert(surface->current.transform);
 		wlr_matrix_project_box(matrix, &dst_box, transform, 0.0,
-			output->transform_matrix);
+			data->transform_matrix);
 
-		render_texture(output, output_damage, texture, NULL, &dst_box, matrix);
+		render_texture(data, output_damage, texture, &src_box, &dst_box,
+			matrix);
 		break;
 	case WLR_SCENE_NODE_RECT:;
 		struct wlr_scene_rect *scene_rect = scene_rect_from_node(node);
 
-		render_rect(output, output_damage, scene_rect->color, &dst_box,
-			output->transform_matrix);
+		render_rect(data, output_damage, scene_rect->color, &dst_box,
+			data->transform_matrix);
 		break;
 	case WLR_SCENE_NODE_BUFFER:;
 		struct wlr_scene_buffer *scene_buffer = scene_buffer_from_node(node);
 
-		struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
-		texture = scene_buffer_get_texture(scene_buffer, renderer);
+		struct wlr_fbox buffer_src_box;
+		texture = scene_buffer_get_texture(scene_buffer, data->renderer,
+			&buffer_src_box, NULL);
 		if (texture == NULL) {
 			return;
 		}
 
 		transform = wlr_output_transform_invert(scene_buffer->transform);
 		wlr_matrix_project_box(matrix, &dst_box, transform, 0.0,
-			output->transform_matrix);
+			data->transform_matrix);
 
-		render_texture(output, output_damage, texture, &scene_buffer->src_box,
+		render_texture(data, output_damage, texture, &buffer_src_box,
 			&dst_box, matrix);
 		break;
 	}
@@ -760,36 +1300,624 @@ static void scene_node_for_each_node(struct wlr_scene_node *node,
 	}
 }
 
-void wlr_scene_render_output(struct wlr_scene *scene, struct wlr_output *output,
-		int lx, int ly, pixman_region32_t *damage) {
-	pixman_region32_t full_region;
-	pixman_region32_init_rect(&full_region, 0, 0, output->width, output->height);
-	if (damage == NULL) {
-		damage = &full_region;
+static struct scene_tree_cache *scene_tree_get_cache(
+		struct wlr_scene_tree *tree, struct wlr_renderer *renderer,
+		float scale) {
+	struct scene_tree_cache *cache;
+	wl_list_for_each(cache, &tree->caches, link) {
+		if (cache->renderer == renderer && cache->scale == scale) {
+			return cache;
+		}
 	}
+	return NULL;
+}
 
-	struct wlr_renderer *renderer =
-		wlr_backend_get_renderer(output->backend);
-	assert(renderer);
+/**
+ * Get the layout position of the tree's bounding box, and the fractional part
+ * of that position once scaled.
+ */
+static void scene_tree_get_cache_origin(struct wlr_scene_tree *tree,
+		float scale, int *lx, int *ly, double *phase_x, double *phase_y) {
+	struct wlr_box bounds;
+	scene_node_get_bounds(&tree->node, &bounds);
+	wlr_scene_node_coords(&tree->node, lx, ly);
+	*lx += bounds.x;
+	*ly += bounds.y;
+	*phase_x = *lx * scale - floor(*lx * scale);
+	*phase_y = *ly * scale - floor(*ly * scale);
+}
 
-	if (output->enabled && pixman_region32_not_empty(damage)) {
-		struct render_data data = {
-			.output = output,
-			.damage = damage,
-		};
-		scene_node_for_each_node(&scene->node, -lx, -ly,
-			render_node_iterator, &data);
-		wlr_renderer_scissor(renderer, NULL);
+static bool scene_tree_cache_is_valid(struct wlr_scene_tree *tree,
+		struct wlr_renderer *renderer, float scale) {
+	struct scene_tree_cache *cache =
+		scene_tree_get_cache(tree, renderer, scale);
+	if (cache == NULL || cache->dirty || cache->texture == NULL) {
+		return false;
 	}
 
-	pixman_region32_fini(&full_region);
+	// Moving the tree by a distance which doesn't scale to whole pixels
+	// changes the rounding of its children
+	int lx, ly;
+	double phase_x, phase_y;
+	scene_tree_get_cache_origin(tree, scale, &lx, &ly, &phase_x, &phase_y);
+	return cache->phase_x == phase_x && cache->phase_y == phase_y;
 }
 
-static void scene_output_handle_destroy(struct wlr_addon *addon) {
-	struct wlr_scene_output *scene_output =
-		wl_container_of(addon, scene_output, addon);
-	wlr_scene_output_destroy(scene_output);
-}
+/**
+ * Destroy the caches which no output of the scene can use anymore, e.g. after
+ * an output scale change.
+ */
+static void scene_tree_prune_caches(struct wlr_scene_tree *tree) {
+	struct wlr_scene *scene = scene_node_get_root(&tree->node);
+
+	struct scene_tree_cache *cache, *tmp;
+	wl_list_for_each_safe(cache, tmp, &tree->caches, link) {
+		bool used = false;
+		struct wlr_scene_output *scene_output;
+		wl_list_for_each(scene_output, &scene->outputs, link) {
+			struct wlr_output *output = scene_output->output;
+			if (output->scale == cache->scale &&
+					wlr_backend_get_renderer(output->backend) ==
+					cache->renderer) {
+				used = true;
+				break;
+			}
+		}
+		if (!used) {
+			scene_tree_cache_destroy(cache);
+		}
+	}
+}
+
+/**
+ * Pick a format with an alpha channel for cache buffers: the parts of the
+ * tree's bounding box not covered by its descendants must stay transparent.
+ */
+static const struct wlr_drm_format *pick_cache_format(
+		struct wlr_renderer *renderer) {
+	const struct wlr_drm_format_set *render_formats =
+		wlr_renderer_get_render_formats(renderer);
+	if (render_formats == NULL) {
+		return NULL;
+	}
+
+	const uint32_t candidates[] = { DRM_FORMAT_ARGB8888, DRM_FORMAT_ABGR8888 };
+	for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+		const struct wlr_drm_format *format =
+			wlr_drm_format_set_get(render_formats, candidates[i]);
+		if (format != NULL) {
+			return format;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Render the descendants of a cached tree into the offscreen buffer for the
+ * output's scale. Does nothing if that cache is up-to-date.
+ */
+static bool scene_tree_update_cache(struct wlr_scene_tree *tree,
+		struct wlr_output *output) {
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	assert(renderer != NULL);
+
+	if (scene_tree_cache_is_valid(tree, renderer, output->scale)) {
+		return true;
+	}
+
+	scene_tree_prune_caches(tree);
+
+	// Children are rendered at their scaled layout position, minus the
+	// scaled position of the bounding box, so that their edges are rounded
+	// the same way as when rendered directly to the output
+	int origin_lx, origin_ly;
+	double phase_x, phase_y;
+	scene_tree_get_cache_origin(tree, output->scale, &origin_lx, &origin_ly,
+		&phase_x, &phase_y);
+
+	struct wlr_box bounds;
+	scene_node_get_bounds(&tree->node, &bounds);
+	struct wlr_box size = {
+		.x = origin_lx,
+		.y = origin_ly,
+		.width = bounds.width,
+		.height = bounds.height,
+	};
+	scale_box(&size, output->scale);
+	if (wlr_box_empty(&size)) {
+		return false;
+	}
+
+	struct scene_tree_cache *cache =
+		scene_tree_get_cache(tree, renderer, output->scale);
+	if (cache != NULL && (cache->buffer->width != size.width ||
+			cache->buffer->height != size.height)) {
+		scene_tree_cache_destroy(cache);
+		cache = NULL;
+	}
+
+	if (cache == NULL) {
+		struct wlr_allocator *allocator = backend_get_allocator(output->backend);
+		if (allocator == NULL) {
+			wlr_log(WLR_ERROR, "Failed to get backend allocator");
+			return false;
+		}
+
+		const struct wlr_drm_format *format = pick_cache_format(renderer);
+		if (format == NULL) {
+			wlr_log(WLR_DEBUG, "Renderer doesn't support any format with "
+				"alpha, not caching tree");
+			return false;
+		}
+
+		cache = calloc(1, sizeof(*cache));
+		if (cache == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return false;
+		}
+		cache->buffer = wlr_allocator_create_buffer(allocator,
+			size.width, size.height, format);
+		if (cache->buffer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to allocate tree cache buffer");
+			free(cache);
+			return false;
+		}
+		cache->renderer = renderer;
+		cache->scale = output->scale;
+		wl_list_insert(&tree->caches, &cache->link);
+	}
+	cache->phase_x = phase_x;
+	cache->phase_y = phase_y;
+
+	wlr_texture_destroy(cache->texture);
+	cache->texture = NULL;
+
+	// Part of the output's frame: don't report it as a frame of its own
+	if (!renderer_begin_internal_with_buffer(renderer, cache->buffer)) {
+		return false;
+	}
+
+	pixman_region32_t damage;
+	pixman_region32_init_rect(&damage, 0, 0, size.width, size.height);
+
+	struct wl_array quads;
+	wl_array_init(&quads);
+
+	struct render_data data = {
+		.renderer = renderer,
+		.transform = WL_OUTPUT_TRANSFORM_NORMAL,
+		.transform_matrix = (float[9]){ 1, 0, 0, 0, 1, 0, 0, 0, 1 },
+		.scale = output->scale,
+		.width = size.width,
+		.height = size.height,
+		.origin_x = size.x,
+		.origin_y = size.y,
+		.damage = &damage,
+		.quads = &quads,
+	};
+
+	wlr_renderer_scissor(renderer, NULL);
+	wlr_renderer_clear(renderer, (float[4]){ 0.0, 0.0, 0.0, 0.0 });
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &tree->node.state.children, state.link) {
+		scene_node_for_each_node(child, origin_lx - bounds.x,
+			origin_ly - bounds.y, render_node_iterator, &data);
+	}
+	flush_render_quads(&data);
+	wlr_renderer_end(renderer);
+
+	wl_array_release(&quads);
+	pixman_region32_fini(&damage);
+
+	cache->texture = wlr_texture_from_buffer(renderer, cache->buffer);
+	if (cache->texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create tree cache texture");
+		return false;
+	}
+
+	cache->dirty = false;
+	return true;
+}
+
+/**
+ * Render a cached tree. x and y are the position of the tree's bounding box
+ * relative to the output, and box is the bounding box in output-buffer-local
+ * coordinates. Falls back to rendering the descendants one by one if the
+ * cache can't be used.
+ */
+static void render_cached_tree(struct wlr_scene_tree *tree, int x, int y,
+		const struct wlr_box *box, struct render_data *data) {
+	if (scene_tree_cache_is_valid(tree, data->renderer, data->scale)) {
+		struct wlr_texture *texture = scene_tree_get_cache(tree,
+			data->renderer, data->scale)->texture;
+		struct wlr_fbox src_box = {
+			.width = texture->width,
+			.height = texture->height,
+		};
+		float matrix[9];
+		wlr_matrix_project_box(matrix, box, WL_OUTPUT_TRANSFORM_NORMAL, 0.0,
+			data->transform_matrix);
+		render_texture(data, data->damage, texture, &src_box, box, matrix);
+		return;
+	}
+
+	struct wlr_box bounds;
+	scene_node_get_bounds(&tree->node, &bounds);
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &tree->node.state.children, state.link) {
+		scene_node_for_each_node(child, x - bounds.x, y - bounds.y,
+			render_node_iterator, data);
+	}
+}
+
+/**
+ * Get the region of a node which is guaranteed to be painted with fully
+ * opaque pixels, in output-buffer-local coordinates. The node's box is given
+ * in output-buffer-local coordinates too, and its position in the layout is
+ * given by x and y (relative to the output).
+ */
+static void scene_node_get_opaque_region(struct wlr_scene_node *node,
+		struct wlr_output *output, int x, int y, const struct wlr_box *box,
+		pixman_region32_t *opaque) {
+	pixman_region32_clear(opaque);
+
+	struct wlr_texture *texture;
+	switch (node->type) {
+	case WLR_SCENE_NODE_ROOT:
+	case WLR_SCENE_NODE_TREE:
+		break;
+	case WLR_SCENE_NODE_SURFACE:;
+		struct wlr_scene_surface *scene_surface = wlr_scene_surface_from_node(node);
+		struct wlr_surface *surface = scene_surface->surface;
+
+		texture = wlr_surface_get_texture(surface);
+		if (texture == NULL) {
+			return;
+		}
+		if (wlr_texture_is_opaque(texture)) {
+			pixman_region32_union_rect(opaque, opaque,
+				box->x, box->y, box->width, box->height);
+			return;
+		}
+
+		pixman_region32_copy(opaque, &surface->opaque_region);
+		pixman_region32_translate(opaque, x, y);
+		wlr_region_scale(opaque, opaque, output->scale);
+		if (floor(output->scale) != output->scale) {
+			// Edge pixels are only partially covered by the opaque region
+			// once scaled, and will be blended
+			wlr_region_expand(opaque, opaque, -1);
+		}
+		pixman_region32_intersect_rect(opaque, opaque,
+			box->x, box->y, box->width, box->height);
+		break;
+	case WLR_SCENE_NODE_RECT:;
+		struct wlr_scene_rect *scene_rect = scene_rect_from_node(node);
+		if (scene_rect->color[3] >= 1.0) {
+			pixman_region32_union_rect(opaque, opaque,
+				box->x, box->y, box->width, box->height);
+		}
+		break;
+	case WLR_SCENE_NODE_BUFFER:;
+		struct wlr_scene_buffer *scene_buffer = scene_buffer_from_node(node);
+
+		struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+		bool is_opaque;
+		scene_buffer_get_texture(scene_buffer, renderer, NULL, &is_opaque);
+		if (is_opaque) {
+			pixman_region32_union_rect(opaque, opaque,
+				box->x, box->y, box->width, box->height);
+		}
+		break;
+	}
+}
+
+struct scene_render_entry {
+	struct wlr_scene_node *node;
+	struct wlr_box box; // in layout coordinates
+};
+
+/**
+ * Append the nodes of a sub-tree intersecting the viewport to the render
+ * list, in rendering order. Sub-trees outside of the viewport are skipped
+ * entirely thanks to their bounding box.
+ */
+static bool scene_node_build_render_list(struct wlr_scene_node *node,
+		int lx, int ly, const struct wlr_box *viewport_box,
+		struct wl_array *render_list) {
+	if (!node->state.enabled) {
+		return true;
+	}
+
+	lx += node->state.x;
+	ly += node->state.y;
+
+	struct wlr_box intersection;
+	struct wlr_box bounds;
+	scene_node_get_bounds(node, &bounds);
+	bounds.x += lx;
+	bounds.y += ly;
+	if (!wlr_box_intersection(&intersection, viewport_box, &bounds)) {
+		return true;
+	}
+
+	// Cached trees are rendered as a whole
+	if (node->type == WLR_SCENE_NODE_TREE &&
+			scene_tree_from_node(node)->cached) {
+		struct scene_render_entry *entry =
+			wl_array_add(render_list, sizeof(*entry));
+		if (entry == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return false;
+		}
+		entry->node = node;
+		entry->box = bounds;
+		return true;
+	}
+
+	struct wlr_box box = { .x = lx, .y = ly };
+	scene_node_get_size(node, &box.width, &box.height);
+	if (wlr_box_intersection(&intersection, viewport_box, &box)) {
+		struct scene_render_entry *entry =
+			wl_array_add(render_list, sizeof(*entry));
+		if (entry == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			return false;
+		}
+		entry->node = node;
+		entry->box = box;
+	}
+
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &node->state.children, state.link) {
+		if (!scene_node_build_render_list(child, lx, ly, viewport_box,
+				render_list)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool scene_build_render_list(struct wlr_scene *scene,
+		const struct wlr_box *viewport_box, struct wl_array *render_list) {
+	render_list->size = 0;
+	return scene_node_build_render_list(&scene->node, 0, 0, viewport_box,
+		render_list);
+}
+
+static const struct wlr_addon_interface output_addon_impl;
+
+static struct wlr_scene_output *scene_get_scene_output(struct wlr_scene *scene,
+		struct wlr_output *output) {
+	struct wlr_addon *addon =
+		wlr_addon_find(&output->addons, scene, &output_addon_impl);
+	if (addon == NULL) {
+		return NULL;
+	}
+	struct wlr_scene_output *scene_output =
+		wl_container_of(addon, scene_output, addon);
+	return scene_output;
+}
+
+/**
+ * Get the list of nodes intersecting the output viewport. The list is only
+ * re-built if the scene-graph or the viewport has changed since the last
+ * call. Returns NULL on allocation failure.
+ */
+static struct wl_array *scene_output_get_render_list(
+		struct wlr_scene_output *scene_output) {
+	struct wlr_box viewport_box = { .x = scene_output->x, .y = scene_output->y };
+	wlr_output_effective_resolution(scene_output->output,
+		&viewport_box.width, &viewport_box.height);
+
+	if (scene_output->render_list_dirty ||
+			memcmp(&viewport_box, &scene_output->render_list_box,
+				sizeof(viewport_box)) != 0) {
+		if (!scene_build_render_list(scene_output->scene, &viewport_box,
+				&scene_output->render_list)) {
+			return NULL;
+		}
+		scene_output->render_list_box = viewport_box;
+		scene_output->render_list_dirty = false;
+	}
+
+	return &scene_output->render_list;
+}
+
+struct render_list_entry {
+	struct wlr_scene_node *node;
+	int x, y; // relative to the output, in layout coordinates
+	struct wlr_box box; // in output-buffer-local coordinates
+	pixman_region32_t damage; // visible part of the box which needs repainting
+};
+
+static bool scene_overlays_contain_node(const struct wl_array *overlays,
+		struct wlr_scene_node *node) {
+	if (overlays == NULL) {
+		return false;
+	}
+	struct scene_overlay *overlay;
+	wl_array_for_each(overlay, overlays) {
+		if (overlay->node == node) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Collect the nodes of the render list which intersect the damage, and
+ * compute the area which needs to be repainted for each of them. Nodes
+ * displayed on overlays are left out. Returns false on allocation failure.
+ */
+static bool build_frame_list(struct wlr_output *output, int lx, int ly,
+		pixman_region32_t *damage, struct wl_array *render_list,
+		const struct wl_array *overlays, struct wl_array *frame_list) {
+	struct scene_render_entry *scene_entry;
+	wl_array_for_each(scene_entry, render_list) {
+		if (scene_overlays_contain_node(overlays, scene_entry->node)) {
+			continue;
+		}
+
+		struct wlr_box box = scene_entry->box;
+		box.x -= lx;
+		box.y -= ly;
+		int x = box.x, y = box.y;
+		scale_box(&box, output->scale);
+		if (wlr_box_empty(&box)) {
+			continue;
+		}
+
+		pixman_box32_t rect = {
+			.x1 = box.x,
+			.y1 = box.y,
+			.x2 = box.x + box.width,
+			.y2 = box.y + box.height,
+		};
+		if (pixman_region32_contains_rectangle(damage, &rect) ==
+				PIXMAN_REGION_OUT) {
+			continue;
+		}
+
+		struct render_list_entry *entry =
+			wl_array_add(frame_list, sizeof(*entry));
+		if (entry == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			struct render_list_entry *added;
+			wl_array_for_each(added, frame_list) {
+				pixman_region32_fini(&added->damage);
+			}
+			return false;
+		}
+
+		entry->node = scene_entry->node;
+		entry->x = x;
+		entry->y = y;
+		entry->box = box;
+		pixman_region32_init_rect(&entry->damage,
+			box.x, box.y, box.width, box.height);
+		pixman_region32_intersect(&entry->damage, &entry->damage, damage);
+	}
+
+	return true;
+}
+
+/**
+ * Walk the frame list front to back, and remove from each entry's damage the
+ * area covered by opaque nodes above it.
+ */
+static void frame_list_cull_occluded(struct wlr_output *output,
+		struct render_list_entry *entries, size_t entries_len) {
+	pixman_region32_t opaque, node_opaque;
+	pixman_region32_init(&opaque);
+	pixman_region32_init(&node_opaque);
+	for (size_t i = entries_len; i-- > 0;) {
+		struct render_list_entry *entry = &entries[i];
+
+		pixman_region32_subtract(&entry->damage, &entry->damage, &opaque);
+		if (!pixman_region32_not_empty(&entry->damage)) {
+			continue;
+		}
+
+		scene_node_get_opaque_region(entry->node, output,
+			entry->x, entry->y, &entry->box, &node_opaque);
+		pixman_region32_union(&opaque, &opaque, &node_opaque);
+	}
+	pixman_region32_fini(&node_opaque);
+	pixman_region32_fini(&opaque);
+}
+
+static void scene_render_output(struct wlr_scene *scene,
+		struct wlr_output *output, int lx, int ly, pixman_region32_t *damage,
+		const struct wl_array *overlays) {
+	pixman_region32_t full_region;
+	pixman_region32_init_rect(&full_region, 0, 0, output->width, output->height);
+	if (damage == NULL) {
+		damage = &full_region;
+	}
+
+	if (!output->enabled || !pixman_region32_not_empty(damage)) {
+		pixman_region32_fini(&full_region);
+		return;
+	}
+
+	struct wl_array tmp_render_list, frame_list, quads;
+	wl_array_init(&tmp_render_list);
+	wl_array_init(&frame_list);
+	wl_array_init(&quads);
+
+	// Re-use the output's render list if it's been built for this viewport
+	struct wl_array *render_list = NULL;
+	struct wlr_scene_output *scene_output = scene_get_scene_output(scene, output);
+	if (scene_output != NULL && scene_output->x == lx && scene_output->y == ly) {
+		render_list = scene_output_get_render_list(scene_output);
+	} else {
+		struct wlr_box viewport_box = { .x = lx, .y = ly };
+		wlr_output_effective_resolution(output,
+			&viewport_box.width, &viewport_box.height);
+		if (scene_build_render_list(scene, &viewport_box, &tmp_render_list)) {
+			render_list = &tmp_render_list;
+		}
+	}
+
+	if (render_list == NULL || !build_frame_list(output, lx, ly, damage,
+			render_list, overlays, &frame_list)) {
+		// Fall back to painting every node without occlusion culling
+		frame_list.size = 0;
+
+		struct render_data data;
+		render_data_init_output(&data, output, damage);
+		data.quads = &quads;
+		scene_node_for_each_node(&scene->node, -lx, -ly,
+			render_node_iterator, &data);
+	}
+
+	struct render_list_entry *entries = frame_list.data;
+	size_t entries_len = frame_list.size / sizeof(entries[0]);
+
+	frame_list_cull_occluded(output, entries, entries_len);
+
+	for (size_t i = 0; i < entries_len; i++) {
+		struct render_list_entry *entry = &entries[i];
+
+		if (pixman_region32_not_empty(&entry->damage)) {
+			struct render_data data;
+			render_data_init_output(&data, output, &entry->damage);
+			data.quads = &quads;
+			if (entry->node->type == WLR_SCENE_NODE_TREE) {
+				render_cached_tree(scene_tree_from_node(entry->node),
+					entry->x, entry->y, &entry->box, &data);
+			} else {
+				render_node_iterator(entry->node, entry->x, entry->y, &data);
+			}
+		}
+
+		pixman_region32_fini(&entry->damage);
+	}
+
+	// Submit the whole frame to the renderer at once
+	struct render_data data;
+	render_data_init_output(&data, output, NULL);
+	data.quads = &quads;
+	flush_render_quads(&data);
+
+	wl_array_release(&quads);
+	wl_array_release(&frame_list);
+	wl_array_release(&tmp_render_list);
+	pixman_region32_fini(&full_region);
+}
+
+void wlr_scene_render_output(struct wlr_scene *scene, struct wlr_output *output,
+		int lx, int ly, pixman_region32_t *damage) {
+	scene_render_output(scene, output, lx, ly, damage, NULL);
+}
+
+static void scene_output_handle_destroy(struct wlr_addon *addon) {
+	struct wlr_scene_output *scene_output =
+		wl_container_of(addon, scene_output, addon);
+	wlr_scene_output_destroy(scene_output);
+}
 
 static const struct wlr_addon_interface output_addon_impl = {
 	.name = "wlr_scene_output",
@@ -798,11 +1926,34 @@ static const struct wlr_addon_interface output_addon_impl = {
 
 struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 		struct wlr_output *output) {
-	struct wlr_scene_output *scene_output = calloc(1, sizeof(*output));
+	struct wlr_scene_output *scene_output = calloc(1, sizeof(*scene_output));
 	if (scene_output == NULL) {
 		return NULL;
 	}
 
+	// Outputs are identified by their index in the visibility bitmask of
+	// scene surfaces, find the lowest one which isn't in use
+	int prev_output_index = -1;
+	struct wl_list *prev_output_link = &scene->outputs;
+
+	struct wlr_scene_output *current_output;
+	wl_list_for_each(current_output, &scene->outputs, link) {
+		if (prev_output_index + 1 != current_output->index) {
+			break;
+		}
+
+		prev_output_index = current_output->index;
+		prev_output_link = &current_output->link;
+	}
+
+	int index = prev_output_index + 1;
+	if (index >= 64) {
+		wlr_log(WLR_ERROR, "Too many outputs in the scene");
+		free(scene_output);
+		return NULL;
+	}
+	scene_output->index = index;
+
 	scene_output->damage = wlr_output_damage_create(output);
 	if (scene_output->damage == NULL) {
 		free(scene_output);
@@ -811,8 +1962,13 @@ struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 
 	scene_output->output = output;
 	scene_output->scene = scene;
+	wl_array_init(&scene_output->render_list);
+	scene_output->render_list_dirty = true;
+	wl_array_init(&scene_output->overlays);
+	wl_array_init(&scene_output->visible_surfaces);
 	wlr_addon_init(&scene_output->addon, &output->addons, scene, &output_addon_impl);
-	wl_list_insert(&scene->outputs, &scene_output->link);
+	// Keep the list sorted by index
+	wl_list_insert(prev_output_link, &scene_output->link);
 
 	wlr_output_damage_add_whole(scene_output->damage);
 
@@ -822,6 +1978,19 @@ struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 void wlr_scene_output_destroy(struct wlr_scene_output *scene_output) {
 	wlr_addon_finish(&scene_output->addon);
 	wl_list_remove(&scene_output->link);
+
+	struct wlr_scene_surface **visible;
+	wl_array_for_each(visible, &scene_output->visible_surfaces) {
+		if (*visible != NULL) {
+			scene_surface_set_visible_outputs(*visible,
+				(*visible)->visible_outputs &
+				~((uint64_t)1 << scene_output->index));
+		}
+	}
+
+	wl_array_release(&scene_output->render_list);
+	wl_array_release(&scene_output->overlays);
+	wl_array_release(&scene_output->visible_surfaces);
 	free(scene_output);
 }
 
@@ -836,84 +2005,332 @@ void wlr_scene_output_set_position(struct wlr_scene_output *scene_output,
 	wlr_output_damage_add_whole(scene_output->damage);
 }
 
-struct check_scanout_data {
-	// in
-	struct wlr_box viewport_box;
-	// out
-	struct wlr_scene_node *node;
-	size_t n;
-};
-
-static void check_scanout_iterator(struct wlr_scene_node *node,
-		int x, int y, void *_data) {
-	struct check_scanout_data *data = _data;
-
-	struct wlr_box node_box = { .x = x, .y = y };
-	scene_node_get_size(node, &node_box.width, &node_box.height);
-
-	struct wlr_box intersection;
-	if (!wlr_box_intersection(&intersection, &data->viewport_box, &node_box)) {
-		return;
-	}
-
-	data->n++;
-
-	if (data->viewport_box.x == node_box.x &&
-			data->viewport_box.y == node_box.y &&
-			data->viewport_box.width == node_box.width &&
-			data->viewport_box.height == node_box.height) {
-		data->node = node;
-	}
-}
-
-static bool scene_output_scanout(struct wlr_scene_output *scene_output) {
-	struct wlr_output *output = scene_output->output;
-
-	struct wlr_box viewport_box = { .x = scene_output->x, .y = scene_output->y };
-	wlr_output_effective_resolution(output,
-		&viewport_box.width, &viewport_box.height);
-
-	struct check_scanout_data check_scanout_data = {
-		.viewport_box = viewport_box,
-	};
-	scene_node_for_each_node(&scene_output->scene->node, 0, 0,
-		check_scanout_iterator, &check_scanout_data);
-	if (check_scanout_data.n != 1 || check_scanout_data.node == NULL) {
-		return false;
-	}
-
-	struct wlr_scene_node *node = check_scanout_data.node;
-	struct wlr_buffer *buffer;
+/**
+ * Get the buffer which can be directly scanned out by the output to display a
+ * node, if any.
+ */
+static struct wlr_buffer *scene_node_get_scanout_buffer(
+		struct wlr_scene_node *node, struct wlr_output *output) {
 	switch (node->type) {
 	case WLR_SCENE_NODE_SURFACE:;
 		struct wlr_scene_surface *scene_surface = wlr_scene_surface_from_node(node);
 		if (scene_surface->surface->buffer == NULL ||
 				scene_surface->surface->current.viewport.has_src ||
 				scene_surface->surface->current.transform != output->transform) {
-			return false;
+			return NULL;
 		}
-		buffer = &scene_surface->surface->buffer->base;
-		break;
+		return &scene_surface->surface->buffer->base;
 	case WLR_SCENE_NODE_BUFFER:;
 		struct wlr_scene_buffer *scene_buffer = scene_buffer_from_node(node);
 		if (scene_buffer->buffer == NULL ||
 				!wlr_fbox_empty(&scene_buffer->src_box) ||
 				scene_buffer->transform != output->transform) {
-			return false;
+			return NULL;
 		}
-		buffer = scene_buffer->buffer;
-		break;
+		return scene_buffer->buffer;
 	default:
+		return NULL;
+	}
+}
+
+static bool scene_output_scanout(struct wlr_scene_output *scene_output) {
+	struct wlr_output *output = scene_output->output;
+
+	struct wl_array *render_list = scene_output_get_render_list(scene_output);
+	if (render_list == NULL) {
+		return false;
+	}
+
+	// Only scan-out a node if it's the only one covering the viewport
+	struct scene_render_entry *entries = render_list->data;
+	if (render_list->size != sizeof(entries[0]) ||
+			memcmp(&entries[0].box, &scene_output->render_list_box,
+				sizeof(entries[0].box)) != 0) {
+		return false;
+	}
+
+	struct wlr_buffer *buffer =
+		scene_node_get_scanout_buffer(entries[0].node, output);
+	if (buffer == NULL) {
 		return false;
 	}
 
 	wlr_output_attach_buffer(output, buffer);
+	wlr_output_set_overlays(output, NULL, 0);
 	if (!wlr_output_test(output)) {
 		wlr_output_rollback(output);
 		return false;
 	}
 
-	return wlr_output_commit(output);
+	if (!wlr_output_commit(output)) {
+		return false;
+	}
+
+	scene_output->overlays.size = 0;
+	return true;
+}
+
+static bool scene_output_has_software_cursor(struct wlr_output *output) {
+	struct wlr_output_cursor *cursor;
+	wl_list_for_each(cursor, &output->cursors, link) {
+		if (cursor->enabled && cursor->visible &&
+				cursor != output->hardware_cursor) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Collect the nodes which could be displayed on output overlays, from top to
+ * bottom. A node is only eligible if no other node is stacked above any part
+ * of it, because overlays are displayed on top of the primary buffer. This
+ * also guarantees that candidates don't overlap each other.
+ */
+static bool scene_output_collect_overlays(struct wlr_scene_output *scene_output,
+		struct wl_array *candidates) {
+	struct wlr_output *output = scene_output->output;
+
+	// Software cursors are drawn into the primary buffer, so they'd end up
+	// below overlays
+	if (scene_output_has_software_cursor(output)) {
+		return true;
+	}
+
+	struct wl_array *render_list = scene_output_get_render_list(scene_output);
+	if (render_list == NULL) {
+		return false;
+	}
+
+	int tr_width, tr_height;
+	wlr_output_transformed_resolution(output, &tr_width, &tr_height);
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(output->transform);
+
+	pixman_region32_t covered;
+	pixman_region32_init(&covered);
+
+	bool ok = true;
+	struct scene_render_entry *entries = render_list->data;
+	size_t entries_len = render_list->size / sizeof(entries[0]);
+	for (size_t i = entries_len; i-- > 0;) {
+		struct scene_render_entry *entry = &entries[i];
+
+		struct wlr_box box = entry->box;
+		box.x -= scene_output->x;
+		box.y -= scene_output->y;
+		scale_box(&box, output->scale);
+		if (wlr_box_empty(&box)) {
+			continue;
+		}
+
+		pixman_box32_t rect = {
+			.x1 = box.x,
+			.y1 = box.y,
+			.x2 = box.x + box.width,
+			.y2 = box.y + box.height,
+		};
+		struct wlr_buffer *buffer =
+			scene_node_get_scanout_buffer(entry->node, output);
+		if (buffer != NULL && rect.x1 >= 0 && rect.y1 >= 0 &&
+				rect.x2 <= tr_width && rect.y2 <= tr_height &&
+				pixman_region32_contains_rectangle(&covered, &rect) ==
+					PIXMAN_REGION_OUT) {
+			struct scene_overlay *overlay =
+				wl_array_add(candidates, sizeof(*overlay));
+			if (overlay == NULL) {
+				wlr_log(WLR_ERROR, "Allocation failed");
+				ok = false;
+				break;
+			}
+			overlay->node = entry->node;
+			overlay->box = box;
+			overlay->overlay.buffer = buffer;
+			wlr_box_transform(&overlay->overlay.dst_box, &box, transform,
+				tr_width, tr_height);
+		}
+
+		pixman_region32_union_rect(&covered, &covered,
+			box.x, box.y, box.width, box.height);
+	}
+
+	pixman_region32_fini(&covered);
+	return ok;
+}
+
+/**
+ * Find the largest set of overlays accepted by the output, and set it as
+ * pending output state. A primary buffer must be attached. On return,
+ * overlays contains the nodes which will be displayed on overlays.
+ */
+static void scene_output_assign_overlays(struct wlr_scene_output *scene_output,
+		struct wl_array *overlays, struct wl_array *output_overlays) {
+	struct wlr_output *output = scene_output->output;
+
+	if (!scene_output_collect_overlays(scene_output, overlays)) {
+		overlays->size = 0;
+	}
+
+	struct scene_overlay *candidates = overlays->data;
+	size_t candidates_len = overlays->size / sizeof(candidates[0]);
+	struct wlr_output_overlay *pending = NULL;
+	if (candidates_len > 0) {
+		pending = wl_array_add(output_overlays,
+			candidates_len * sizeof(pending[0]));
+		if (pending == NULL) {
+			wlr_log(WLR_ERROR, "Allocation failed");
+			candidates_len = 0;
+		}
+	}
+
+	// Each overlay plane assignment is checked by the backend, so grow the
+	// set one node at a time and stop at the first rejection
+	size_t accepted_len = 0;
+	for (size_t i = 0; i < candidates_len; i++) {
+		pending[i] = candidates[i].overlay;
+		wlr_output_set_overlays(output, pending, i + 1);
+		if (!wlr_output_test(output)) {
+			break;
+		}
+		accepted_len = i + 1;
+	}
+	overlays->size = accepted_len * sizeof(candidates[0]);
+
+	wlr_output_set_overlays(output, pending, accepted_len);
+}
+
+static bool scene_overlays_equal(const struct wl_array *a,
+		const struct wl_array *b) {
+	if (a->size != b->size) {
+		return false;
+	}
+	const struct scene_overlay *a_overlays = a->data, *b_overlays = b->data;
+	size_t len = a->size / sizeof(a_overlays[0]);
+	for (size_t i = 0; i < len; i++) {
+		const struct scene_overlay *oa = &a_overlays[i], *ob = &b_overlays[i];
+		if (oa->node != ob->node || oa->overlay.buffer != ob->overlay.buffer ||
+				memcmp(&oa->box, &ob->box, sizeof(oa->box)) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void scene_overlays_add_damage(const struct wl_array *overlays,
+		pixman_region32_t *damage) {
+	struct scene_overlay *overlay;
+	wl_array_for_each(overlay, overlays) {
+		pixman_region32_union_rect(damage, damage, overlay->box.x,
+			overlay->box.y, overlay->box.width, overlay->box.height);
+	}
+}
+
+static void scene_output_update_caches(struct wlr_scene_output *scene_output) {
+	struct wl_array *render_list = scene_output_get_render_list(scene_output);
+	if (render_list == NULL) {
+		return;
+	}
+
+	struct scene_render_entry *entry;
+	wl_array_for_each(entry, render_list) {
+		if (entry->node->type != WLR_SCENE_NODE_TREE) {
+			continue;
+		}
+		struct wlr_scene_tree *tree = scene_tree_from_node(entry->node);
+		if (!scene_tree_update_cache(tree, scene_output->output)) {
+			wlr_log(WLR_DEBUG, "Failed to update scene tree cache");
+		}
+	}
+}
+
+static void scene_output_add_visible_surface(
+		struct wlr_scene_output *scene_output,
+		struct wlr_scene_surface *scene_surface) {
+	uint64_t mask = (uint64_t)1 << scene_output->index;
+	if (scene_surface->visible_outputs & mask) {
+		return;
+	}
+
+	struct wlr_scene_surface **entry =
+		wl_array_add(&scene_output->visible_surfaces, sizeof(*entry));
+	if (entry == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	*entry = scene_surface;
+	scene_surface_set_visible_outputs(scene_surface,
+		scene_surface->visible_outputs | mask);
+}
+
+static void scene_node_add_visible_surfaces(
+		struct wlr_scene_output *scene_output, struct wlr_scene_node *node) {
+	if (!node->state.enabled) {
+		return;
+	}
+
+	if (node->type == WLR_SCENE_NODE_SURFACE) {
+		scene_output_add_visible_surface(scene_output,
+			wlr_scene_surface_from_node(node));
+	}
+
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &node->state.children, state.link) {
+		scene_node_add_visible_surfaces(scene_output, child);
+	}
+}
+
+/**
+ * Re-compute the set of surfaces visible on the output, i.e. the surfaces
+ * which intersect the output and aren't fully covered by opaque nodes.
+ */
+static void scene_output_update_visibility(
+		struct wlr_scene_output *scene_output) {
+	struct wlr_output *output = scene_output->output;
+	uint64_t mask = (uint64_t)1 << scene_output->index;
+
+	struct wlr_scene_surface **visible;
+	wl_array_for_each(visible, &scene_output->visible_surfaces) {
+		if (*visible != NULL) {
+			scene_surface_set_visible_outputs(*visible,
+				(*visible)->visible_outputs & ~mask);
+		}
+	}
+	scene_output->visible_surfaces.size = 0;
+
+	struct wl_array *render_list = scene_output_get_render_list(scene_output);
+	if (render_list == NULL) {
+		return;
+	}
+
+	pixman_region32_t full_region;
+	pixman_region32_init_rect(&full_region, 0, 0, output->width, output->height);
+
+	struct wl_array frame_list;
+	wl_array_init(&frame_list);
+	if (!build_frame_list(output, scene_output->x, scene_output->y,
+			&full_region, render_list, NULL, &frame_list)) {
+		pixman_region32_fini(&full_region);
+		return;
+	}
+
+	struct render_list_entry *entries = frame_list.data;
+	size_t entries_len = frame_list.size / sizeof(entries[0]);
+	frame_list_cull_occluded(output, entries, entries_len);
+
+	for (size_t i = 0; i < entries_len; i++) {
+		struct render_list_entry *entry = &entries[i];
+
+		if (pixman_region32_not_empty(&entry->damage)) {
+			// Cached trees are a single entry, their descendants are all
+			// considered visible
+			scene_node_add_visible_surfaces(scene_output, entry->node);
+		}
+
+		pixman_region32_fini(&entry->damage);
+	}
+
+	wl_array_release(&frame_list);
+	pixman_region32_fini(&full_region);
 }
 
 bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
@@ -931,9 +2348,13 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 	}
 	scene_output->prev_scanout = scanout;
 	if (scanout) {
+		scene_output_update_visibility(scene_output);
 		return true;
 	}
 
+	// This needs to happen before the output's buffer is bound
+	scene_output_update_caches(scene_output);
+
 	bool needs_frame;
 	pixman_region32_t damage;
 	pixman_region32_init(&damage);
@@ -949,6 +2370,24 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 		return true;
 	}
 
+	struct wl_array overlays, output_overlays;
+	wl_array_init(&overlays);
+	wl_array_init(&output_overlays);
+	scene_output_assign_overlays(scene_output, &overlays, &output_overlays);
+
+	// Nodes moving to or from overlays need to be repainted in the primary
+	// buffer
+	if (!scene_overlays_equal(&overlays, &scene_output->overlays)) {
+		pixman_region32_t overlays_damage;
+		pixman_region32_init(&overlays_damage);
+		scene_overlays_add_damage(&scene_output->overlays, &overlays_damage);
+		scene_overlays_add_damage(&overlays, &overlays_damage);
+		pixman_region32_union(&damage, &damage, &overlays_damage);
+		pixman_region32_union(&scene_output->damage->current,
+			&scene_output->damage->current, &overlays_damage);
+		pixman_region32_fini(&overlays_damage);
+	}
+
 	wlr_renderer_begin(renderer, output->width, output->height);
 
 	int nrects;
@@ -958,8 +2397,8 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 		wlr_renderer_clear(renderer, (float[4]){ 0.0, 0.0, 0.0, 1.0 });
 	}
 
-	wlr_scene_render_output(scene_output->scene, output,
-		scene_output->x, scene_output->y, &damage);
+	scene_render_output(scene_output->scene, output,
+		scene_output->x, scene_output->y, &damage, &overlays);
 	wlr_output_render_software_cursors(output, &damage);
 
 	wlr_renderer_end(renderer);
@@ -978,7 +2417,16 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 	wlr_output_set_damage(output, &frame_damage);
 	pixman_region32_fini(&frame_damage);
 
-	return wlr_output_commit(output);
+	bool ok = wlr_output_commit(output);
+	if (ok) {
+		wl_array_release(&scene_output->overlays);
+		scene_output->overlays = overlays;
+		scene_output_update_visibility(scene_output);
+	} else {
+		wl_array_release(&overlays);
+	}
+	wl_array_release(&output_overlays);
+	return ok;
 }
 
 static void scene_output_for_each_surface(const struct wlr_box *output_box,
@@ -1012,9 +2460,62 @@ static void scene_output_for_each_surface(const struct wlr_box *output_box,
 
 void wlr_scene_output_for_each_surface(struct wlr_scene_output *scene_output,
 		wlr_surface_iterator_func_t iterator, void *user_data) {
-	struct wlr_box box = { .x = scene_output->x, .y = scene_output->y };
+	struct wl_array *render_list = scene_output_get_render_list(scene_output);
+	if (render_list == NULL) {
+		struct wlr_box box = { .x = scene_output->x, .y = scene_output->y };
+		wlr_output_effective_resolution(scene_output->output,
+			&box.width, &box.height);
+		scene_output_for_each_surface(&box, &scene_output->scene->node, 0, 0,
+			iterator, user_data);
+		return;
+	}
+
+	struct wlr_box output_box = { .x = scene_output->x, .y = scene_output->y };
 	wlr_output_effective_resolution(scene_output->output,
-		&box.width, &box.height);
-	scene_output_for_each_surface(&box, &scene_output->scene->node, 0, 0,
-		iterator, user_data);
+		&output_box.width, &output_box.height);
+
+	struct scene_render_entry *entry;
+	wl_array_for_each(entry, render_list) {
+		if (entry->node->type == WLR_SCENE_NODE_SURFACE) {
+			struct wlr_scene_surface *scene_surface =
+				wlr_scene_surface_from_node(entry->node);
+			iterator(scene_surface->surface, entry->box.x, entry->box.y,
+				user_data);
+		} else if (entry->node->type == WLR_SCENE_NODE_TREE) {
+			// Cached trees are a single entry, walk their descendants
+			int lx, ly;
+			wlr_scene_node_coords(entry->node, &lx, &ly);
+			struct wlr_scene_node *child;
+			wl_list_for_each(child, &entry->node->state.children, state.link) {
+				scene_output_for_each_surface(&output_box, child, lx, ly,
+					iterator, user_data);
+			}
+		}
+	}
+}
+
+void wlr_scene_output_send_frame_done(struct wlr_scene_output *scene_output,
+		const struct timespec *now) {
+	struct wlr_scene_surface **visible;
+	wl_array_for_each(visible, &scene_output->visible_surfaces) {
+		if (*visible != NULL) {
+			wlr_surface_send_frame_done((*visible)->surface, now);
+		}
+	}
+
+	// Hidden surfaces are shared by all outputs, whichever output reaches
+	// the end of the interval first takes care of them
+	struct wlr_scene *scene = scene_output->scene;
+	struct timespec elapsed;
+	timespec_sub(&elapsed, now, &scene->last_hidden_frame_done);
+	if (timespec_to_msec(&elapsed) < scene->hidden_frame_interval_ms) {
+		return;
+	}
+	scene->last_hidden_frame_done = *now;
+
+	// Includes the surfaces of disabled nodes
+	struct wlr_scene_surface *scene_surface;
+	wl_list_for_each(scene_surface, &scene->hidden_surfaces, hidden_link) {
+		wlr_surface_send_frame_done(scene_surface->surface, now);
+	}
 }
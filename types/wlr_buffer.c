@@ -6,7 +6,10 @@
 #include <wlr/types/wlr_drm.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/util/log.h>
+#include "render/allocator/allocator.h"
+#include "render/drm_format_set.h"
 #include "render/pixel_format.h"
+#include "render/wlr_renderer.h"
 #include "types/wlr_buffer.h"
 #include "util/signal.h"
 
@@ -126,6 +129,9 @@ static void client_buffer_destroy(struct wlr_buffer *buffer) {
 	struct wlr_client_buffer *client_buffer = client_buffer_from_buffer(buffer);
 	wl_list_remove(&client_buffer->source_destroy.link);
 	wlr_texture_destroy(client_buffer->texture);
+	if (client_buffer->copy != NULL) {
+		wlr_buffer_drop(client_buffer->copy);
+	}
 	free(client_buffer);
 }
 
@@ -133,6 +139,10 @@ static bool client_buffer_get_dmabuf(struct wlr_buffer *buffer,
 		struct wlr_dmabuf_attributes *attribs) {
 	struct wlr_client_buffer *client_buffer = client_buffer_from_buffer(buffer);
 
+	if (client_buffer->copy != NULL) {
+		// The source contents may be older than the copy's
+		return wlr_buffer_get_dmabuf(client_buffer->copy, attribs);
+	}
 	if (client_buffer->source == NULL) {
 		return false;
 	}
@@ -234,18 +244,11 @@ struct wlr_buffer *wlr_buffer_from_resource(struct wl_resource *resource) {
 	return buffer;
 }
 
-struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
-		struct wlr_renderer *renderer) {
-	struct wlr_texture *texture = wlr_texture_from_buffer(renderer, buffer);
-	if (texture == NULL) {
-		wlr_log(WLR_ERROR, "Failed to create texture");
-		return NULL;
-	}
-
+static struct wlr_client_buffer *client_buffer_create(
+		struct wlr_buffer *buffer, struct wlr_texture *texture) {
 	struct wlr_client_buffer *client_buffer =
 		calloc(1, sizeof(struct wlr_client_buffer));
 	if (client_buffer == NULL) {
-		wlr_texture_destroy(texture);
 		return NULL;
 	}
 	wlr_buffer_init(&client_buffer->base, &client_buffer_impl,
@@ -271,6 +274,149 @@ struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
 	return client_buffer;
 }
 
+struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
+		struct wlr_renderer *renderer) {
+	struct wlr_texture *texture = wlr_texture_from_buffer(renderer, buffer);
+	if (texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create texture");
+		return NULL;
+	}
+
+	struct wlr_client_buffer *client_buffer =
+		client_buffer_create(buffer, texture);
+	if (client_buffer == NULL) {
+		wlr_texture_destroy(texture);
+		return NULL;
+	}
+	return client_buffer;
+}
+
+/**
+ * Render the region of the source buffer into the destination buffer. Both
+ * buffers must have the same size.
+ */
+static bool copy_buffer_region(struct wlr_renderer *renderer,
+		struct wlr_buffer *dst, struct wlr_buffer *src,
+		pixman_region32_t *region) {
+	// Textures imported from client buffers are cached by the renderer, so
+	// this doesn't re-import buffers the client keeps cycling through
+	struct wlr_texture *texture = wlr_texture_from_buffer(renderer, src);
+	if (texture == NULL) {
+		return false;
+	}
+
+	if (!renderer_begin_internal_with_buffer(renderer, dst)) {
+		wlr_texture_destroy(texture);
+		return false;
+	}
+
+	pixman_region32_t clipped;
+	pixman_region32_init(&clipped);
+	pixman_region32_intersect_rect(&clipped, region,
+		0, 0, dst->width, dst->height);
+
+	// The contents are replaced: clear the destination before blending the
+	// source over it
+	const float identity[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+	bool ok = true;
+	int rects_len;
+	const pixman_box32_t *rects =
+		pixman_region32_rectangles(&clipped, &rects_len);
+	for (int i = 0; i < rects_len && ok; i++) {
+		struct wlr_box box = {
+			.x = rects[i].x1,
+			.y = rects[i].y1,
+			.width = rects[i].x2 - rects[i].x1,
+			.height = rects[i].y2 - rects[i].y1,
+		};
+		wlr_renderer_scissor(renderer, &box);
+		wlr_renderer_clear(renderer, (float[4]){ 0.0, 0.0, 0.0, 0.0 });
+		ok = wlr_render_texture(renderer, texture, identity, 0, 0, 1.0);
+	}
+	wlr_renderer_scissor(renderer, NULL);
+	wlr_renderer_end(renderer);
+
+	pixman_region32_fini(&clipped);
+	wlr_texture_destroy(texture);
+	return ok;
+}
+
+struct wlr_client_buffer *client_buffer_create_copy(struct wlr_buffer *buffer,
+		struct wlr_renderer *renderer, struct wlr_allocator *allocator) {
+	struct wlr_dmabuf_attributes dmabuf;
+	if (!wlr_buffer_get_dmabuf(buffer, &dmabuf)) {
+		return NULL;
+	}
+
+	const struct wlr_drm_format *format = wlr_drm_format_set_get(
+		wlr_renderer_get_render_formats(renderer), dmabuf.format);
+	if (format == NULL) {
+		return NULL;
+	}
+
+	struct wlr_buffer *copy = wlr_allocator_create_buffer(allocator,
+		buffer->width, buffer->height, format);
+	if (copy == NULL) {
+		wlr_log(WLR_DEBUG, "Failed to allocate client buffer copy");
+		return NULL;
+	}
+
+	pixman_region32_t region;
+	pixman_region32_init_rect(&region, 0, 0, buffer->width, buffer->height);
+	bool ok = copy_buffer_region(renderer, copy, buffer, &region);
+	pixman_region32_fini(&region);
+	if (!ok) {
+		wlr_log(WLR_DEBUG, "Failed to copy client buffer");
+		wlr_buffer_drop(copy);
+		return NULL;
+	}
+
+	struct wlr_texture *texture = wlr_texture_from_buffer(renderer, copy);
+	if (texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create texture");
+		wlr_buffer_drop(copy);
+		return NULL;
+	}
+
+	struct wlr_client_buffer *client_buffer =
+		client_buffer_create(buffer, texture);
+	if (client_buffer == NULL) {
+		wlr_texture_destroy(texture);
+		wlr_buffer_drop(copy);
+		return NULL;
+	}
+	client_buffer->copy = copy;
+	client_buffer->renderer = renderer;
+	return client_buffer;
+}
+
+static bool client_buffer_apply_copy_damage(
+		struct wlr_client_buffer *client_buffer, struct wlr_buffer *next,
+		pixman_region32_t *damage) {
+	struct wlr_dmabuf_attributes dmabuf, copy_dmabuf;
+	if (!wlr_buffer_get_dmabuf(next, &dmabuf) ||
+			!wlr_buffer_get_dmabuf(client_buffer->copy, &copy_dmabuf) ||
+			dmabuf.format != copy_dmabuf.format) {
+		return false;
+	}
+
+	if (!copy_buffer_region(client_buffer->renderer, client_buffer->copy,
+			next, damage)) {
+		return false;
+	}
+
+	// Re-importing the copy returns the same texture for renderers caching
+	// imported buffers, and makes sure the new contents are sampled
+	struct wlr_texture *texture =
+		wlr_texture_from_buffer(client_buffer->renderer, client_buffer->copy);
+	if (texture == NULL) {
+		return false;
+	}
+	wlr_texture_destroy(client_buffer->texture);
+	client_buffer->texture = texture;
+	return true;
+}
+
 bool wlr_client_buffer_apply_damage(struct wlr_client_buffer *client_buffer,
 		struct wlr_buffer *next, pixman_region32_t *damage) {
 	if (client_buffer->base.n_locks > 1) {
@@ -283,6 +429,10 @@ bool wlr_client_buffer_apply_damage(struct wlr_client_buffer *client_buffer,
 		return false;
 	}
 
+	if (client_buffer->copy != NULL) {
+		return client_buffer_apply_copy_damage(client_buffer, next, damage);
+	}
+
 	if (client_buffer->shm_source_format == DRM_FORMAT_INVALID) {
 		// Uploading only damaged regions only works for wl_shm buffers and
 		// mutable textures (created from wl_shm buffer)
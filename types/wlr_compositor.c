@@ -4,6 +4,7 @@
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_surface.h>
 #include <wlr/util/log.h>
+#include "render/allocator/allocator.h"
 #include "types/wlr_region.h"
 #include "types/wlr_surface.h"
 #include "util/signal.h"
@@ -120,7 +121,8 @@ static void compositor_create_surface(struct wl_client *client,
 	struct wlr_compositor *compositor = compositor_from_resource(resource);
 
 	struct wlr_surface *surface = surface_create(client,
-		wl_resource_get_version(resource), id, compositor->renderer);
+		wl_resource_get_version(resource), id, compositor->renderer,
+		compositor->allocator);
 	if (surface == NULL) {
 		wl_client_post_no_memory(client);
 		return;
@@ -159,6 +161,7 @@ static void handle_display_destroy(struct wl_listener *listener, void *data) {
 	subcompositor_finish(&compositor->subcompositor);
 	wl_list_remove(&compositor->display_destroy.link);
 	wl_global_destroy(compositor->global);
+	wlr_allocator_destroy(compositor->allocator);
 	free(compositor);
 }
 
@@ -190,3 +193,11 @@ struct wlr_compositor *wlr_compositor_create(struct wl_display *display,
 
 	return compositor;
 }
+
+bool wlr_compositor_enable_buffer_copies(struct wlr_compositor *compositor) {
+	if (compositor->allocator == NULL) {
+		compositor->allocator =
+			allocator_autocreate_offscreen(compositor->renderer);
+	}
+	return compositor->allocator != NULL;
+}
@@ -10,6 +10,7 @@
 #include <wlr/types/wlr_output.h>
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
+#include "types/wlr_buffer.h"
 #include "types/wlr_surface.h"
 #include "util/signal.h"
 #include "util/time.h"
@@ -327,6 +328,37 @@ static void surface_damage_subsurfaces(struct wlr_subsurface *subsurface) {
 	}
 }
 
+/**
+ * Check whether the surface's buffer should be kept as a compositor-owned copy
+ * updated with the damaged regions only, rather than being imported as-is.
+ * This is worth it if the client keeps the size and only updates small parts
+ * of its buffers.
+ *
+ * If the current buffer is locked by someone else, it is most likely being
+ * scanned out: import the client's buffer directly so that it can be scanned
+ * out without a copy as well.
+ */
+static bool surface_should_copy_buffer(struct wlr_surface *surface) {
+	if (surface->allocator == NULL || surface->buffer == NULL ||
+			surface->buffer->base.n_locks > 1 ||
+			surface->buffer->base.width != surface->current.buffer->width ||
+			surface->buffer->base.height != surface->current.buffer->height) {
+		return false;
+	}
+
+	int64_t damage_area = 0;
+	int rects_len;
+	const pixman_box32_t *rects =
+		pixman_region32_rectangles(&surface->buffer_damage, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		damage_area += (int64_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+	}
+	int64_t buffer_area = (int64_t)surface->current.buffer->width *
+		surface->current.buffer->height;
+	return damage_area * 4 <= buffer_area;
+}
+
 static void surface_apply_damage(struct wlr_surface *surface) {
 	if (surface->current.buffer == NULL) {
 		// NULL commit
@@ -346,8 +378,15 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 		}
 	}
 
-	struct wlr_client_buffer *buffer = wlr_client_buffer_create(
-			surface->current.buffer, surface->renderer);
+	struct wlr_client_buffer *buffer = NULL;
+	if (surface_should_copy_buffer(surface)) {
+		buffer = client_buffer_create_copy(surface->current.buffer,
+			surface->renderer, surface->allocator);
+	}
+	if (buffer == NULL) {
+		buffer = wlr_client_buffer_create(surface->current.buffer,
+			surface->renderer);
+	}
 
 	wlr_buffer_unlock(surface->current.buffer);
 	surface->current.buffer = NULL;
@@ -720,7 +759,8 @@ static void surface_handle_renderer_destroy(struct wl_listener *listener,
 }
 
 struct wlr_surface *surface_create(struct wl_client *client,
-		uint32_t version, uint32_t id, struct wlr_renderer *renderer) {
+		uint32_t version, uint32_t id, struct wlr_renderer *renderer,
+		struct wlr_allocator *allocator) {
 	struct wlr_surface *surface = calloc(1, sizeof(struct wlr_surface));
 	if (!surface) {
 		wl_client_post_no_memory(client);
@@ -739,6 +779,7 @@ struct wlr_surface *surface_create(struct wl_client *client,
 	wlr_log(WLR_DEBUG, "New wlr_surface %p (res %p)", surface, surface->resource);
 
 	surface->renderer = renderer;
+	surface->allocator = allocator;
 
 	surface_state_init(&surface->current);
 	surface_state_init(&surface->pending);